@@ -17,6 +17,38 @@
 //
 // Update: openSSL has an MD5, should have expected that. That was an unexpected
 // dependency. So, you gotta have openSSL installed.
+//
+// Update: the search is embarrassingly parallel, so there's now a threaded mode
+// that hands out chunks of seeds to a pool of workers. The catch is that the
+// answer has to be the *smallest* seed, and a later chunk can easily finish
+// before an earlier one. So chunks are handed out strictly in order, each worker
+// reports the first match inside its own chunk, and the shared best only ever
+// moves down. Workers quit once the next chunk starts beyond the best seed for
+// both targets, which means everything below those seeds has been searched.
+//
+// Update: no more openSSL. MD5 is now done in here, mostly so the search can
+// hash a batch of seeds at once in vector lanes (4, 8 or 16 wide, picked at
+// runtime by what the cpu supports, with a scalar fallback). Every message in the
+// puzzle is a single 64 byte block, so a lane kernel is just one compression
+// per lane. The openSSL link dependency is gone along with it.
+//
+// Update: profiling showed sprintf and re-hashing the secret were a big chunk of
+// each seed. Now the seed is an ASCII counter that increments in place, and any
+// whole 64 byte blocks of the secret are hashed once up front into a midstate.
+// Each seed then costs only the final block, whatever the length of the secret.
+//
+// Update: the 5 and 6 zero checks are now just two cases of a general target, a
+// hex pattern for the start of the hash with '?' wildcards. Any number of them
+// (-z for leading zeros, -p for a pattern) are found in the one sweep, each with
+// the time it was found. The old string-ized vs binary comparison is gone, since
+// it meant sweeping the whole space a second time just to prove a point.
+//
+// Update: high-difficulty targets can run for hours, so with --checkpoint the
+// search writes a file every so often with how far it has fully searched for
+// each target, and --resume picks up from there after a crash. With --cache,
+// finished answers go into a file keyed by secret and pattern, so asking again
+// is instant. Both are off unless asked for, so a plain run never depends on
+// what some earlier run left lying around.
 
 #include <stdio.h>
 #include <ctype.h>
@@ -25,7 +57,10 @@
 #include <stdlib.h>
 #include <time.h>
 #include <limits.h>
-#include <openssl/md5.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <pthread.h>
+#include <stdint.h>
 
 char *trim(char *str) {
     char *p = str + (strlen(str) - 1);
@@ -35,12 +70,266 @@ char *trim(char *str) {
     return str;
 }
 
-unsigned char *calculate_MD5(unsigned char *input, size_t len) {
-    static unsigned char hash[MD5_DIGEST_LENGTH];
+#define MD5_DIGEST_LENGTH   16
+#define MD5_BLOCK_SIZE      64
+#define MAX_LANES           16
+
+// The MD5 step functions and the 64 steps are written as macros over a generic
+// type, so the same text compiles as plain uint32_t for the scalar version, and
+// as a gcc/clang vector of uint32_t for the multi-lane versions. The vector
+// extensions let '+', '^', '<<' etc. work across all lanes at once, including
+// mixing in scalar constants.
+#define MD5_F(x, y, z)      ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z)      ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z)      ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z)      ((y) ^ ((x) | ~(z)))
+#define ROTL32(x, s)        (((x) << (s)) | ((x) >> (32 - (s))))
+
+#define MD5_STEP(f, a, b, c, d, m, k, s) \
+    (a) += f((b), (c), (d)) + (m) + (uint32_t)(k); \
+    (a) = ROTL32((a), (s)) + (b)
+
+#define MD5_ROUNDS(a, b, c, d, m) \
+    MD5_STEP(MD5_F, a, b, c, d, m[ 0], 0xd76aa478,  7); \
+    MD5_STEP(MD5_F, d, a, b, c, m[ 1], 0xe8c7b756, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, m[ 2], 0x242070db, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, m[ 3], 0xc1bdceee, 22); \
+    MD5_STEP(MD5_F, a, b, c, d, m[ 4], 0xf57c0faf,  7); \
+    MD5_STEP(MD5_F, d, a, b, c, m[ 5], 0x4787c62a, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, m[ 6], 0xa8304613, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, m[ 7], 0xfd469501, 22); \
+    MD5_STEP(MD5_F, a, b, c, d, m[ 8], 0x698098d8,  7); \
+    MD5_STEP(MD5_F, d, a, b, c, m[ 9], 0x8b44f7af, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, m[10], 0xffff5bb1, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, m[11], 0x895cd7be, 22); \
+    MD5_STEP(MD5_F, a, b, c, d, m[12], 0x6b901122,  7); \
+    MD5_STEP(MD5_F, d, a, b, c, m[13], 0xfd987193, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, m[14], 0xa679438e, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, m[15], 0x49b40821, 22); \
+    MD5_STEP(MD5_G, a, b, c, d, m[ 1], 0xf61e2562,  5); \
+    MD5_STEP(MD5_G, d, a, b, c, m[ 6], 0xc040b340,  9); \
+    MD5_STEP(MD5_G, c, d, a, b, m[11], 0x265e5a51, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, m[ 0], 0xe9b6c7aa, 20); \
+    MD5_STEP(MD5_G, a, b, c, d, m[ 5], 0xd62f105d,  5); \
+    MD5_STEP(MD5_G, d, a, b, c, m[10], 0x02441453,  9); \
+    MD5_STEP(MD5_G, c, d, a, b, m[15], 0xd8a1e681, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, m[ 4], 0xe7d3fbc8, 20); \
+    MD5_STEP(MD5_G, a, b, c, d, m[ 9], 0x21e1cde6,  5); \
+    MD5_STEP(MD5_G, d, a, b, c, m[14], 0xc33707d6,  9); \
+    MD5_STEP(MD5_G, c, d, a, b, m[ 3], 0xf4d50d87, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, m[ 8], 0x455a14ed, 20); \
+    MD5_STEP(MD5_G, a, b, c, d, m[13], 0xa9e3e905,  5); \
+    MD5_STEP(MD5_G, d, a, b, c, m[ 2], 0xfcefa3f8,  9); \
+    MD5_STEP(MD5_G, c, d, a, b, m[ 7], 0x676f02d9, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, m[12], 0x8d2a4c8a, 20); \
+    MD5_STEP(MD5_H, a, b, c, d, m[ 5], 0xfffa3942,  4); \
+    MD5_STEP(MD5_H, d, a, b, c, m[ 8], 0x8771f681, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, m[11], 0x6d9d6122, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, m[14], 0xfde5380c, 23); \
+    MD5_STEP(MD5_H, a, b, c, d, m[ 1], 0xa4beea44,  4); \
+    MD5_STEP(MD5_H, d, a, b, c, m[ 4], 0x4bdecfa9, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, m[ 7], 0xf6bb4b60, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, m[10], 0xbebfbc70, 23); \
+    MD5_STEP(MD5_H, a, b, c, d, m[13], 0x289b7ec6,  4); \
+    MD5_STEP(MD5_H, d, a, b, c, m[ 0], 0xeaa127fa, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, m[ 3], 0xd4ef3085, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, m[ 6], 0x04881d05, 23); \
+    MD5_STEP(MD5_H, a, b, c, d, m[ 9], 0xd9d4d039,  4); \
+    MD5_STEP(MD5_H, d, a, b, c, m[12], 0xe6db99e5, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, m[15], 0x1fa27cf8, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, m[ 2], 0xc4ac5665, 23); \
+    MD5_STEP(MD5_I, a, b, c, d, m[ 0], 0xf4292244,  6); \
+    MD5_STEP(MD5_I, d, a, b, c, m[ 7], 0x432aff97, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, m[14], 0xab9423a7, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, m[ 5], 0xfc93a039, 21); \
+    MD5_STEP(MD5_I, a, b, c, d, m[12], 0x655b59c3,  6); \
+    MD5_STEP(MD5_I, d, a, b, c, m[ 3], 0x8f0ccc92, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, m[10], 0xffeff47d, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, m[ 1], 0x85845dd1, 21); \
+    MD5_STEP(MD5_I, a, b, c, d, m[ 8], 0x6fa87e4f,  6); \
+    MD5_STEP(MD5_I, d, a, b, c, m[15], 0xfe2ce6e0, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, m[ 6], 0xa3014314, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, m[13], 0x4e0811a1, 21); \
+    MD5_STEP(MD5_I, a, b, c, d, m[ 4], 0xf7537e82,  6); \
+    MD5_STEP(MD5_I, d, a, b, c, m[11], 0xbd3af235, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, m[ 2], 0x2ad7d2bb, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, m[ 9], 0xeb86d391, 21)
+
+const uint32_t md5_initial_state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+// MD5 is little-endian all the way through, so do the byte shuffling by hand
+// rather than trusting the host.
+uint32_t load_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void store_le32(unsigned char *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+void md5_compress(uint32_t state[4], const uint32_t m[16]) {
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
 
-    MD5(input, len, hash);
+    MD5_ROUNDS(a, b, c, d, m);
 
-    return hash;
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+// Runs every whole 64 byte block of the input through the state, and returns
+// how many bytes that was. This is how the constant secret gets hashed once.
+size_t md5_absorb(uint32_t state[4], const unsigned char *input, size_t len) {
+    uint32_t m[16];
+    size_t full = len / MD5_BLOCK_SIZE * MD5_BLOCK_SIZE;
+
+    for (size_t i = 0; i < full; i += MD5_BLOCK_SIZE) {
+        for (int w = 0; w < 16; w++)
+            m[w] = load_le32(input + i + 4 * w);
+        md5_compress(state, m);
+    }
+
+    return full;
+}
+
+// Picks up from a midstate that has already absorbed 'done' bytes of the
+// message, and hashes the rest of it.
+void md5_resume(const uint32_t midstate[4], size_t done, const unsigned char *input, size_t len,
+                unsigned char hash[MD5_DIGEST_LENGTH]) {
+    uint32_t state[4];
+    unsigned char tail[2 * MD5_BLOCK_SIZE];
+
+    memcpy(state, midstate, sizeof(state));
+    size_t full = md5_absorb(state, input, len);
+
+    // the leftovers get the 0x80 terminator, zero padding, and the bit length
+    // in the last 8 bytes, which may spill into a second block
+    size_t rest = len - full;
+    size_t tail_len = (rest < 56) ? MD5_BLOCK_SIZE : 2 * MD5_BLOCK_SIZE;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, input + full, rest);
+    tail[rest] = 0x80;
+    uint64_t bits = (uint64_t)(done + len) * 8;
+    store_le32(tail + tail_len - 8, (uint32_t)bits);
+    store_le32(tail + tail_len - 4, (uint32_t)(bits >> 32));
+
+    md5_absorb(state, tail, tail_len);
+
+    for (int w = 0; w < 4; w++)
+        store_le32(hash + 4 * w, state[w]);
+}
+
+// The whole thing, any length, one message at a time. This is the replacement
+// for the openSSL MD5() call.
+void md5(const unsigned char *input, size_t len, unsigned char hash[MD5_DIGEST_LENGTH]) {
+    md5_resume(md5_initial_state, 0, input, len, hash);
+}
+
+// A lane kernel runs one compression for N independent messages at once. Both
+// the blocks and the resulting states are interleaved by lane, so word w of
+// lane l lives at [w * N + l], which is exactly the layout of an array of
+// vectors. Every lane starts from the same state, which is all the search needs.
+typedef void (*md5_lanes_fn)(const uint32_t init[4], const uint32_t *blocks, uint32_t *states);
+
+typedef struct {
+    const char *name;
+    int lanes;
+    md5_lanes_fn compress;
+} md5_engine;
+
+#define DEFINE_MD5_LANES(name, V, N, attr)                                      \
+attr void name(const uint32_t init[4], const uint32_t *blocks, uint32_t *states) { \
+    V m[16], a, b, c, d;                                                        \
+    memcpy(m, blocks, sizeof(m));                                               \
+    a = (V){0} + init[0];                                                       \
+    b = (V){0} + init[1];                                                       \
+    c = (V){0} + init[2];                                                       \
+    d = (V){0} + init[3];                                                       \
+    MD5_ROUNDS(a, b, c, d, m);                                                  \
+    a += init[0];                                                               \
+    b += init[1];                                                               \
+    c += init[2];                                                               \
+    d += init[3];                                                               \
+    memcpy(states + 0 * N, &a, sizeof(V));                                      \
+    memcpy(states + 1 * N, &b, sizeof(V));                                      \
+    memcpy(states + 2 * N, &c, sizeof(V));                                      \
+    memcpy(states + 3 * N, &d, sizeof(V));                                      \
+}
+
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+typedef uint32_t u32x8 __attribute__((vector_size(32)));
+typedef uint32_t u32x16 __attribute__((vector_size(64)));
+
+DEFINE_MD5_LANES(md5_lanes_1, uint32_t, 1, )
+DEFINE_MD5_LANES(md5_lanes_4, u32x4, 4, )
+
+// the wider kernels only make sense where the cpu can actually do them, so
+// they're compiled for those instruction sets and picked at runtime.
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_LANES
+DEFINE_MD5_LANES(md5_lanes_8_avx2, u32x8, 8, __attribute__((target("avx2"))))
+DEFINE_MD5_LANES(md5_lanes_16_avx512, u32x16, 16, __attribute__((target("avx512f"))))
+#endif
+
+md5_engine md5_engines[] = {
+#ifdef HAVE_X86_LANES
+    { "avx512", 16, md5_lanes_16_avx512 },
+    { "avx2",    8, md5_lanes_8_avx2 },
+#endif
+    { "simd4",   4, md5_lanes_4 },
+    { "scalar",  1, md5_lanes_1 },
+};
+#define MD5_ENGINE_COUNT    (int)(sizeof(md5_engines) / sizeof(md5_engines[0]))
+
+bool md5_engine_supported(const md5_engine *e) {
+#ifdef HAVE_X86_LANES
+    __builtin_cpu_init();
+    if (strcmp(e->name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    if (strcmp(e->name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return true;
+}
+
+// with no name, picks the widest engine the cpu supports; the list is ordered
+// widest first and always ends with the scalar one.
+const md5_engine *select_md5_engine(const char *name) {
+    for (int i = 0; i < MD5_ENGINE_COUNT; i++) {
+        const md5_engine *e = &md5_engines[i];
+        if (name && strcmp(name, e->name) != 0)
+            continue;
+        if (md5_engine_supported(e))
+            return e;
+        fprintf(stderr, "error: the cpu does not support the '%s' MD5 engine.\n", e->name);
+        return NULL;
+    }
+
+    fprintf(stderr, "error: there is no MD5 engine named '%s'.\n", name);
+    return NULL;
+}
+
+// pads the short final piece of a message into a single block and scatters it
+// into lane l. total is the length of the whole message, midstate included.
+void pack_lane_block(uint32_t *blocks, int lanes, int l, const unsigned char *msg, size_t len, size_t total) {
+    unsigned char block[MD5_BLOCK_SIZE];
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, msg, len);
+    block[len] = 0x80;
+    store_le32(block + 56, (uint32_t)(total * 8));
+
+    for (int w = 0; w < 16; w++)
+        blocks[w * lanes + l] = load_le32(block + 4 * w);
+}
+
+void unpack_lane_hash(const uint32_t *states, int lanes, int l, unsigned char hash[MD5_DIGEST_LENGTH]) {
+    for (int w = 0; w < 4; w++)
+        store_le32(hash + 4 * w, states[w * lanes + l]);
 }
 
 char *stringify_MD5(unsigned char *hash) {
@@ -54,93 +343,656 @@ char *stringify_MD5(unsigned char *hash) {
     return result;
 }
 
-bool is_target_hash_5(const unsigned char *hash) {
-    // since it's an array of bytes, the string representation of '00000' really
-    // means that the first 2.5 bytes are 0; the third byte has 0 in the high
-    // nibble, meaning less than 16.
-    return *(hash + 0) == 0 &&
-           *(hash + 1) == 0 &&
-           *(hash + 2) < 16;
+// A target is a pattern for the start of the hex string of a hash, one nibble
+// per character, where '?' matches any nibble. So part 1 is "00000", part 2 is
+// "000000", and anything else is fair game. It's turned into a byte mask and
+// value so a hash is tested in binary without ever rendering it to a string.
+#define MAX_TARGETS         16
+#define MAX_LABEL_LENGTH    40
+#define NOT_FOUND           INT_MAX
+
+typedef struct {
+    char label[MAX_LABEL_LENGTH];
+    char pattern[2 * MD5_DIGEST_LENGTH + 1];
+    unsigned char mask[MD5_DIGEST_LENGTH];
+    unsigned char value[MD5_DIGEST_LENGTH];
+    int bytes;              // how many bytes of the hash the pattern touches
+    int best;               // smallest matching seed found so far
+    double found_at;        // seconds into the search when best was found
+    bool cached;            // best came from the cache, not a search
+} hash_target;
+
+bool make_target(hash_target *t, const char *label, const char *pattern) {
+    size_t len = strlen(pattern);
+
+    if (len == 0 || len > 2 * MD5_DIGEST_LENGTH) {
+        fprintf(stderr, "error: target pattern '%s' must be 1 to %d nibbles.\n", pattern, 2 * MD5_DIGEST_LENGTH);
+        return false;
+    }
+
+    memset(t, 0, sizeof(*t));
+    snprintf(t->label, sizeof(t->label), "%s", label);
+    strcpy(t->pattern, pattern);
+    t->bytes = (len + 1) / 2;
+    t->best = NOT_FOUND;
+
+    for (size_t i = 0; i < len; i++) {
+        int shift = (i % 2) ? 0 : 4;
+        char c = t->pattern[i] = tolower(pattern[i]);
+
+        if (c == '?')
+            continue;
+        if (!isxdigit(c)) {
+            fprintf(stderr, "error: target pattern '%s' can only have hex digits and '?'.\n", pattern);
+            return false;
+        }
+
+        int nibble = isdigit(c) ? c - '0' : c - 'a' + 10;
+        t->mask[i / 2] |= 0xf << shift;
+        t->value[i / 2] |= nibble << shift;
+    }
+
+    return true;
 }
 
-bool is_target_hash_6(const unsigned char *hash) {
-    // since it's an array of bytes, the string representation of '000000'
-    // can be tested by making sure that the first 3 bytes are 0.
-    return *(hash + 0) == 0 &&
-           *(hash + 1) == 0 &&
-           *(hash + 2) == 0;
+bool make_zeros_target(hash_target *t, const char *label, int zeros) {
+    char pattern[2 * MD5_DIGEST_LENGTH + 1];
+
+    if (zeros < 1 || zeros > 2 * MD5_DIGEST_LENGTH) {
+        fprintf(stderr, "error: can only look for 1 to %d leading zeros.\n", 2 * MD5_DIGEST_LENGTH);
+        return false;
+    }
+
+    memset(pattern, '0', zeros);
+    pattern[zeros] = '\0';
+    return make_target(t, label, pattern);
 }
 
-bool is_target_hash_str_5(const char *hash) {
-    char target[] = "00000";
-    return strncmp(hash, target, strlen(target)) == 0;
+bool is_target_hash(const hash_target *t, const unsigned char *hash) {
+    for (int i = 0; i < t->bytes; i++) {
+        if ((hash[i] & t->mask[i]) != t->value[i])
+            return false;
+    }
+    return true;
 }
 
-bool is_target_hash_str_6(const char *hash) {
-    char target[] = "000000";
-    return strncmp(hash, target, strlen(target)) == 0;
+// clock() is cpu time summed across all threads, which makes the threaded
+// search look slower than the single one. so use wall time for that.
+double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-int main(int argc, char ** argv) {
-    FILE    *args = stdin;
-    char    secret[128];
-    bool    found1 = false, found2 = false;
-    int     seed;
+// seeds per unit of work handed to a thread. big enough that the lock isn't
+// contended, small enough that no thread is far past the answer when it's found.
+#define CHUNK_SIZE      8192
+#define MAX_THREADS     256
 
-    fgets(secret, sizeof(secret), args);
-    trim(secret);
+// the longest decimal seed, INT_MAX, is 10 digits. a message has to leave room
+// for the 0x80 terminator and the 8 byte length to fit in one block.
+#define MAX_SEED_DIGITS     10
+#define MAX_ONE_BLOCK       55
 
-    clock_t start = clock();
+// An ASCII decimal counter that increments in place, so the hot loop never has
+// to sprintf a seed. The digits are right-aligned in the buffer and text points
+// at the most significant one, so a carry out the top just moves it left.
+typedef struct {
+    char buf[MAX_SEED_DIGITS + 1];
+    char *text;
+    int len;
+} seed_counter;
 
-    // Part 1, find the numeric value that, when appended to the input string,
-    // results in a MD5 hash that begins with the sequence '00000'.
-    // Part 2 is the same, except 6 zeros, '000000'. So we can easily check
-    // both while looping and doing all the grunt work for hashes one time only.
-    for (seed = 0; !(found2 && found1) && seed < INT_MAX; seed++) {
-        char input[30];
-        sprintf(input, "%s%d", secret, seed);
-
-        unsigned char *hash = calculate_MD5((unsigned char *)input, strlen(input));
-        char *hashstr = stringify_MD5(hash);
-
-        if (!found1 && is_target_hash_str_5(hashstr)) {
-            found1 = true;
-            printf("part 1 (00000) : for '%s', the MD5 hash '%s' is made with %d\n", secret, hashstr, seed);
+void counter_set(seed_counter *c, int seed) {
+    char digits[MAX_SEED_DIGITS + 1];
+
+    c->len = snprintf(digits, sizeof(digits), "%d", seed);
+    c->text = c->buf + MAX_SEED_DIGITS - c->len;
+    memcpy(c->text, digits, c->len + 1);
+}
+
+void counter_increment(seed_counter *c) {
+    char *p = c->buf + MAX_SEED_DIGITS - 1;
+
+    while (p >= c->text && *p == '9')
+        *p-- = '0';
+
+    if (p >= c->text)
+        (*p)++;
+    else {
+        *p = '1';
+        c->text = p;
+        c->len++;
+    }
+}
+
+typedef struct {
+    const char *secret;
+    const md5_engine *engine;
+    uint32_t midstate[4];   // MD5 state after the whole 64 byte blocks of the secret
+    size_t midstate_len;    // how many bytes of the secret that covers
+    const char *tail;       // what's left of the secret, hashed along with each seed
+    size_t tail_len;
+    hash_target *targets;   // everything being looked for in the one sweep
+    int target_count;
+    double start_time;
+    int next_seed;          // start of the next chunk to hand out
+    int searched;           // every seed below this has been fully searched
+    bool *finished;         // ring of chunks done out of order, the first is 'searched'
+    int finished_capacity;  // always a power of 2
+    int finished_first;     // where the chunk at 'searched' is in the ring
+    int active_workers;
+    double finish_time;     // when the last worker stopped
+    long long hashes;       // total hashes calculated, for the rate
+    pthread_mutex_t lock;
+    pthread_cond_t all_done;
+} search_state;
+
+// Chunks finish in any order, but a checkpoint can only promise the seeds below
+// the first gap. While one thread is still on the chunk at the gap, the others
+// keep finishing chunks past it, as many as they get through, so the ring of
+// finished chunks grows to fit however far ahead they get.
+void grow_finished(search_state *s, int needed) {
+    int capacity = s->finished_capacity;
+    while (capacity < needed)
+        capacity *= 2;
+
+    bool *finished = calloc(capacity, sizeof(bool));
+    if (!finished) {
+        fprintf(stderr, "error: cannot allocate memory for %d finished chunks.\n", capacity);
+        exit(1);
+    }
+    for (int i = 0; i < s->finished_capacity; i++)
+        finished[i] = s->finished[(s->finished_first + i) & (s->finished_capacity - 1)];
+
+    free(s->finished);
+    s->finished = finished;
+    s->finished_capacity = capacity;
+    s->finished_first = 0;
+}
+
+void mark_chunk_done(search_state *s, int start) {
+    int ahead = (start - s->searched) / CHUNK_SIZE;
+
+    if (ahead >= s->finished_capacity)
+        grow_finished(s, ahead + 1);
+    s->finished[(s->finished_first + ahead) & (s->finished_capacity - 1)] = true;
+
+    while (s->finished[s->finished_first]) {
+        s->finished[s->finished_first] = false;
+        s->finished_first = (s->finished_first + 1) & (s->finished_capacity - 1);
+        s->searched += CHUNK_SIZE;
+    }
+}
+
+// a target is settled once everything below its best seed has been searched
+bool is_target_settled(const hash_target *t, int searched) {
+    return t->best != NOT_FOUND && searched >= t->best;
+}
+
+// the sweep is done for everyone once the next chunk starts past every target's
+// best seed, because all the seeds below those have been handed out already.
+bool search_is_done(search_state *s, int next_seed) {
+    if (next_seed > INT_MAX - CHUNK_SIZE)
+        return true;
+
+    for (int t = 0; t < s->target_count; t++) {
+        if (next_seed < s->targets[t].best)
+            return false;
+    }
+    return true;
+}
+
+// hashes the next 'lanes' seeds from the counter into hashes[], in order, and
+// leaves the counter just past them. Only the tail of the secret and the digits
+// get hashed, starting from the midstate. When those fit in one block, that's a
+// single compression per seed, done across all the lanes of the engine at once.
+void hash_seed_batch(search_state *s, seed_counter *seed, unsigned char hashes[][MD5_DIGEST_LENGTH]) {
+    unsigned char message[MD5_BLOCK_SIZE + MAX_SEED_DIGITS];
+    uint32_t blocks[16 * MAX_LANES] = { 0 }, states[4 * MAX_LANES];
+    int lanes = s->engine->lanes;
+
+    memcpy(message, s->tail, s->tail_len);
+
+    // the digit count can grow by one inside a batch, so check for the longer
+    if (s->tail_len + seed->len + 1 > MAX_ONE_BLOCK) {
+        for (int l = 0; l < lanes; l++, counter_increment(seed)) {
+            memcpy(message + s->tail_len, seed->text, seed->len);
+            md5_resume(s->midstate, s->midstate_len, message, s->tail_len + seed->len, hashes[l]);
         }
+        return;
+    }
+
+    for (int l = 0; l < lanes; l++, counter_increment(seed)) {
+        size_t len = s->tail_len + seed->len;
+        memcpy(message + s->tail_len, seed->text, seed->len);
+        pack_lane_block(blocks, lanes, l, message, len, s->midstate_len + len);
+    }
+
+    s->engine->compress(s->midstate, blocks, states);
 
-        if (!found2 && is_target_hash_str_6(hashstr)) {
-            found2 = true;
-            printf("part 2 (000000): for '%s', the MD5 hash '%s' is made with %d\n", secret, hashstr, seed);
+    for (int l = 0; l < lanes; l++)
+        unpack_lane_hash(states, lanes, l, hashes[l]);
+}
+
+void *search_worker(void *arg) {
+    search_state *s = arg;
+    unsigned char hashes[MAX_LANES][MD5_DIGEST_LENGTH];
+    int found[MAX_TARGETS];
+    seed_counter seed;
+    int lanes = s->engine->lanes;
+    long long hashed = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        int start = s->next_seed;
+        bool done = search_is_done(s, start);
+        if (!done)
+            s->next_seed += CHUNK_SIZE;
+        pthread_mutex_unlock(&s->lock);
+
+        if (done)
+            break;
+
+        // only the first match in a chunk matters, anything later in the chunk
+        // is bigger, and anything in a later chunk is bigger still. so the chunk
+        // is over once every target has a match. the chunk size is a multiple of
+        // every lane count, so batches never straddle chunks.
+        int remaining = s->target_count;
+        for (int t = 0; t < s->target_count; t++)
+            found[t] = NOT_FOUND;
+
+        counter_set(&seed, start);
+        for (int batch = start; remaining && batch < start + CHUNK_SIZE; batch += lanes) {
+            hash_seed_batch(s, &seed, hashes);
+            hashed += lanes;
+
+            for (int l = 0; l < lanes; l++) {
+                for (int t = 0; t < s->target_count; t++) {
+                    if (found[t] == NOT_FOUND && is_target_hash(&s->targets[t], hashes[l])) {
+                        found[t] = batch + l;
+                        remaining--;
+                    }
+                }
+            }
+        }
+
+        double now = wall_seconds() - s->start_time;
+
+        pthread_mutex_lock(&s->lock);
+        for (int t = 0; t < s->target_count; t++) {
+            if (found[t] < s->targets[t].best) {
+                s->targets[t].best = found[t];
+                s->targets[t].found_at = now;
+            }
+        }
+        mark_chunk_done(s, start);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->hashes += hashed;
+    if (--s->active_workers == 0) {
+        s->finish_time = wall_seconds();
+        pthread_cond_signal(&s->all_done);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+void report_target(const hash_target *t, const char *secret) {
+    char input[160];
+    unsigned char hash[MD5_DIGEST_LENGTH];
+
+    if (t->best == NOT_FOUND) {
+        printf("%s (%s): for '%s', no seed found\n", t->label, t->pattern, secret);
+        return;
+    }
+
+    int len = snprintf(input, sizeof(input), "%s%d", secret, t->best);
+    md5((unsigned char *)input, len, hash);
+    if (t->cached)
+        printf("%s (%s): for '%s', the MD5 hash '%s' is made with %d, found in the cache\n",
+            t->label, t->pattern, secret, stringify_MD5(hash), t->best);
+    else
+        printf("%s (%s): for '%s', the MD5 hash '%s' is made with %d, found at %lf seconds\n",
+            t->label, t->pattern, secret, stringify_MD5(hash), t->best, t->found_at);
+}
+
+typedef struct {
+    const md5_engine *engine;
+    int thread_count;
+    const char *cache_path;         // NULL to not use a cache
+    const char *checkpoint_path;    // NULL to not checkpoint
+    double checkpoint_every;        // seconds between checkpoints
+    bool resume;                    // pick up from the checkpoint file
+} search_options;
+
+// The cache and the checkpoint are both plain text, tab separated since the
+// secret could have spaces in it:
+//   cache:      secret  pattern  seed
+//   checkpoint: secret  pattern  searched  best (-1 if none yet)
+// A checkpoint says every seed below 'searched' has been checked for that
+// target, so a resume can start there instead of at 0.
+#define MAX_LINE_LENGTH     256
+
+int split_tabs(char *line, char **fields, int max) {
+    int count = 0;
+
+    trim(line);
+    while (count < max) {
+        fields[count++] = line;
+        line = strchr(line, '\t');
+        if (!line)
+            break;
+        *line++ = '\0';
+    }
+    return count;
+}
+
+void load_cache(const char *path, const char *secret, hash_target *targets, int target_count) {
+    FILE *f = fopen(path, "r");
+    char line[MAX_LINE_LENGTH];
+    char *fields[3];
+
+    if (!f)
+        return;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (split_tabs(line, fields, 3) != 3 || strcmp(fields[0], secret) != 0)
+            continue;
+
+        for (int t = 0; t < target_count; t++) {
+            if (strcmp(fields[1], targets[t].pattern) == 0) {
+                targets[t].best = atoi(fields[2]);
+                targets[t].cached = true;
+            }
+        }
+    }
+
+    fclose(f);
+}
+
+void save_cache(const char *path, const char *secret, const hash_target *targets, int target_count) {
+    FILE *f = fopen(path, "a");
+
+    if (!f) {
+        fprintf(stderr, "error: cannot write to the cache file '%s'.\n", path);
+        return;
+    }
+
+    for (int t = 0; t < target_count; t++) {
+        if (!targets[t].cached && targets[t].best != NOT_FOUND)
+            fprintf(f, "%s\t%s\t%d\n", secret, targets[t].pattern, targets[t].best);
+    }
+
+    fclose(f);
+}
+
+// returns the seed to resume the sweep from, which is the least searched of the
+// targets that aren't settled yet, and loads any seeds already found along the
+// way. If they're all settled, it's past all of them, so there's nothing to do.
+int load_checkpoint(const char *path, const char *secret, hash_target *targets, int target_count) {
+    FILE *f = fopen(path, "r");
+    char line[MAX_LINE_LENGTH];
+    char *fields[4];
+    int searched[MAX_TARGETS];
+    int resume_from = INT_MAX, settled_at = 0;
+
+    if (!f) {
+        fprintf(stderr, "error: no checkpoint file '%s' to resume from, starting at 0.\n", path);
+        return 0;
+    }
+
+    for (int t = 0; t < target_count; t++)
+        searched[t] = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (split_tabs(line, fields, 4) != 4 || strcmp(fields[0], secret) != 0)
+            continue;
+
+        for (int t = 0; t < target_count; t++) {
+            if (strcmp(fields[1], targets[t].pattern) == 0) {
+                searched[t] = atoi(fields[2]);
+                if (atoi(fields[3]) >= 0)
+                    targets[t].best = atoi(fields[3]);
+            }
+        }
+    }
+
+    fclose(f);
+
+    // targets that were already settled don't need any of it searched again
+    for (int t = 0; t < target_count; t++) {
+        if (!is_target_settled(&targets[t], searched[t]))
+            resume_from = MIN(resume_from, searched[t]);
+        else
+            settled_at = MAX(settled_at, searched[t]);
+    }
+
+    return (resume_from == INT_MAX) ? settled_at : resume_from;
+}
+
+// writes to a temp file and renames it over the old one, so a crash in the
+// middle of writing never leaves a broken checkpoint behind
+void save_checkpoint(const char *path, search_state *s) {
+    char temp_path[MAX_LINE_LENGTH];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *f = fopen(temp_path, "w");
+
+    if (!f) {
+        fprintf(stderr, "error: cannot write the checkpoint file '%s'.\n", temp_path);
+        return;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    for (int t = 0; t < s->target_count; t++) {
+        const hash_target *target = &s->targets[t];
+        int searched = (target->best == NOT_FOUND) ? s->searched : MIN(s->searched, target->best);
+        fprintf(f, "%s\t%s\t%d\t%d\n", s->secret, target->pattern, searched,
+            (target->best == NOT_FOUND) ? -1 : target->best);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    fclose(f);
+    rename(temp_path, path);
+}
+
+// Finds the smallest seed for every target in a single sweep of the seeds.
+// Anything already in the cache isn't searched for at all.
+void search_targets(const char *secret, hash_target *targets, int target_count, const search_options *opt) {
+    pthread_t threads[MAX_THREADS];
+    hash_target *sweep[MAX_TARGETS];
+    hash_target sweep_targets[MAX_TARGETS];
+    search_state s;
+    int sweep_count = 0;
+
+    if (opt->cache_path)
+        load_cache(opt->cache_path, secret, targets, target_count);
+
+    for (int t = 0; t < target_count; t++) {
+        if (!targets[t].cached) {
+            sweep[sweep_count] = &targets[t];
+            sweep_targets[sweep_count++] = targets[t];
         }
     }
 
-    clock_t end = clock();
-    printf("Calculated hashes in %lf seconds, using string-ized hashes.\n", (double)(end - start) / CLOCKS_PER_SEC);
+    if (sweep_count == 0) {
+        for (int t = 0; t < target_count; t++)
+            report_target(&targets[t], secret);
+        return;
+    }
+
+    s.secret = secret;
+    s.engine = opt->engine;
+    memcpy(s.midstate, md5_initial_state, sizeof(s.midstate));
+    s.midstate_len = md5_absorb(s.midstate, (const unsigned char *)secret, strlen(secret));
+    s.tail = secret + s.midstate_len;
+    s.tail_len = strlen(s.tail);
+    s.targets = sweep_targets;
+    s.target_count = sweep_count;
+    s.hashes = 0;
+    s.next_seed = 0;
+    s.finished_capacity = 64;      // grows if it has to, as a power of 2
+    s.finished = calloc(s.finished_capacity, sizeof(bool));
+    s.finished_first = 0;
+    if (!s.finished) {
+        fprintf(stderr, "error: cannot allocate memory for the finished chunks.\n");
+        return;
+    }
+    s.active_workers = opt->thread_count;
+    pthread_mutex_init(&s.lock, NULL);
+
+    // the waits below are against the same clock as wall_seconds()
+    pthread_condattr_t monotonic;
+    pthread_condattr_init(&monotonic);
+    pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC);
+    pthread_cond_init(&s.all_done, &monotonic);
+    pthread_condattr_destroy(&monotonic);
+
+    if (opt->resume && opt->checkpoint_path) {
+        s.next_seed = load_checkpoint(opt->checkpoint_path, secret, sweep_targets, sweep_count);
+        printf("Resuming the search at seed %d.\n", s.next_seed);
+    }
+    s.searched = s.next_seed;
+
+    s.start_time = wall_seconds();
+    double last_checkpoint = s.start_time;
 
-    // This implementation is using binary comparison for the first N bytes of
-    // the hash, then rendering to string once a match is found.
-    start = clock();
-    found1 = found2 = false;
+    for (int i = 0; i < opt->thread_count; i++)
+        pthread_create(&threads[i], NULL, search_worker, &s);
 
-    for (seed = 0; !(found2 && found1) && seed < INT_MAX; seed++) {
-        char input[30];
-        sprintf(input, "%s%d", secret, seed);
+    // The main thread sleeps until the last worker wakes it, only getting up
+    // early when there's a checkpoint due. save_checkpoint takes the lock
+    // itself, so it's let go of for that.
+    pthread_mutex_lock(&s.lock);
+    while (s.active_workers > 0) {
+        if (!opt->checkpoint_path) {
+            pthread_cond_wait(&s.all_done, &s.lock);
+            continue;
+        }
 
-        unsigned char *hash = calculate_MD5((unsigned char *)input, strlen(input));
+        double due = last_checkpoint + opt->checkpoint_every;
+        struct timespec until = { (time_t)due, (long)((due - (time_t)due) * 1e9) };
+        pthread_cond_timedwait(&s.all_done, &s.lock, &until);
 
-        if (!found1 && is_target_hash_5(hash)) {
-            found1 = true;
-            printf("part 1 (00000) : for '%s', the MD5 hash '%s' is made with %d\n", secret, stringify_MD5(hash), seed);
+        if (s.active_workers > 0 && wall_seconds() >= due) {
+            pthread_mutex_unlock(&s.lock);
+            save_checkpoint(opt->checkpoint_path, &s);
+            last_checkpoint = wall_seconds();
+            pthread_mutex_lock(&s.lock);
         }
+    }
+    pthread_mutex_unlock(&s.lock);
+
+    for (int i = 0; i < opt->thread_count; i++)
+        pthread_join(threads[i], NULL);
+
+    double elapsed = s.finish_time - s.start_time;
 
-        if (!found2 && is_target_hash_6(hash)) {
-            found2 = true;
-            printf("part 2 (000000): for '%s', the MD5 hash '%s' is made with %d\n", secret, stringify_MD5(hash), seed);
+    for (int t = 0; t < sweep_count; t++)
+        *sweep[t] = sweep_targets[t];
+
+    // the checkpoint has served its purpose once every target is settled, but
+    // if the seeds ran out first, it's kept up to date for whoever tries next
+    bool settled = true;
+    for (int t = 0; t < sweep_count; t++)
+        settled = settled && is_target_settled(&sweep_targets[t], s.searched);
+
+    if (opt->checkpoint_path) {
+        if (settled)
+            remove(opt->checkpoint_path);
+        else
+            save_checkpoint(opt->checkpoint_path, &s);
+    }
+    if (opt->cache_path)
+        save_cache(opt->cache_path, secret, targets, target_count);
+
+    for (int t = 0; t < target_count; t++)
+        report_target(&targets[t], secret);
+    printf("Calculated %lld hashes in %lf seconds, using %d threads and the %s MD5 engine (%.2lf Mhash/s).\n",
+        s.hashes, elapsed, opt->thread_count,
+        (s.tail_len + MAX_SEED_DIGITS <= MAX_ONE_BLOCK) ? opt->engine->name : "md5",
+        s.hashes / elapsed / 1e6);
+
+    pthread_cond_destroy(&s.all_done);
+    pthread_mutex_destroy(&s.lock);
+    free(s.finished);
+}
+
+int main(int argc, char ** argv) {
+    FILE    *args = stdin;
+    char    secret[128];
+    char    *engine_name = NULL;
+    hash_target targets[MAX_TARGETS];
+    int     target_count = 0;
+    search_options opt;
+
+    opt.thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    opt.cache_path = NULL;
+    opt.checkpoint_path = NULL;
+    opt.checkpoint_every = 60;
+    opt.resume = false;
+
+    for (int i = 1; i < argc; i++) {
+        char label[MAX_LABEL_LENGTH];
+        snprintf(label, sizeof(label), "target %d", target_count + 1);
+
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            opt.thread_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            engine_name = argv[++i];
+        else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc && target_count < MAX_TARGETS) {
+            if (!make_zeros_target(&targets[target_count++], label, atoi(argv[++i])))
+                return 1;
         }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc && target_count < MAX_TARGETS) {
+            if (!make_target(&targets[target_count++], label, argv[++i]))
+                return 1;
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            opt.cache_path = argv[++i];
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+            opt.checkpoint_path = argv[++i];
+        else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+            opt.checkpoint_every = atof(argv[++i]);
+        else if (strcmp(argv[i], "--resume") == 0)
+            opt.resume = true;
+        else {
+            fprintf(stderr, "usage: %s [-t threads] [-e avx512|avx2|simd4|scalar] [-z zeros]... [-p pattern]...\n"
+                            "       [--cache file] [--checkpoint file] [--every seconds] [--resume] < input\n",
+                            argv[0]);
+            return 1;
+        }
+    }
+    opt.thread_count = MAX(1, MIN(opt.thread_count, MAX_THREADS));
+    if (opt.resume && !opt.checkpoint_path) {
+        fprintf(stderr, "error: --resume needs a --checkpoint file to resume from.\n");
+        return 1;
+    }
+    if (!(opt.checkpoint_every > 0)) {
+        fprintf(stderr, "error: --every needs a number of seconds above 0.\n");
+        return 1;
+    }
+
+    // Part 1, find the numeric value that, when appended to the input string,
+    // results in a MD5 hash that begins with the sequence '00000'.
+    // Part 2 is the same, except 6 zeros, '000000'. Those are the default
+    // targets, and they're both found in the same sweep.
+    if (target_count == 0) {
+        make_zeros_target(&targets[target_count++], "part 1", 5);
+        make_zeros_target(&targets[target_count++], "part 2", 6);
     }
 
-    end = clock();
-    printf("Calculated hashes in %lf seconds, using binary hashes.\n", (double)(end - start) / CLOCKS_PER_SEC);
+    fgets(secret, sizeof(secret), args);
+    trim(secret);
+
+    opt.engine = select_md5_engine(engine_name);
+    if (!opt.engine)
+        return 1;
+
+    search_targets(secret, targets, target_count, &opt);
 
     return 0;
 }
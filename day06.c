@@ -26,12 +26,99 @@
 // that instead of on or off, the operations increment and decrement each bulb's
 // brightness. So refactoring everything to use ints instead of bools (2mb of
 // memory for the collection!) and create new operation execution.
+//
+// Update: touching every cell of every rectangle is a lot of work for what's
+// really only a few hundred rectangles. All of their edges cut the grid into
+// blocks, and every cell in a block gets exactly the same operations, so one
+// value per block is enough, counted up by the block's area at the end. That's
+// the compressed engine, '-m compressed'. Its cost goes with the number of
+// edges, not the size of the grid, so '-s 100000x100000' is no problem for it.
+// The instructions all get read in first now, since it needs every edge before
+// it can start. The grid is '-s' sized, still 1000x1000 unless told otherwise.
+//
+// Update: part 1 only ever needed a bit per light, not a whole double. Packed
+// into 64-bit words the grid is 125kb instead of 8mb, and a rectangle's row is
+// a few words: OR for on, AND-NOT for off, XOR for toggle, with the two end
+// words masked. Counting what's on is a popcount per word.
+//
+// Update: part 2 gets the same treatment. A light is a uint16_t now, which
+// holds anything 32k toggles can do, and each opcode has its own row kernel
+// working on a vector of lights at once, without an if in sight. Off is adding
+// the all-ones (-1) that (v != 0) gives, so zeros stay put. On and toggle add
+// and then OR in the all-ones of (r < v) to stick at the top if they wrapped.
+// Adding it all up widens to 32-bit lanes and then into a long, since an int
+// total runs out on a big enough grid.
+//
+// Update: the README has the story of trying char, short, int, long and double
+// by editing LIGHT_TYPE and rebuilding. Now every storage gets built at once,
+// from the same macro, and picked when it runs: '-b bits|bytes' for part 1 and
+// '-d u8|u16|u32|u64' for part 2. '-B' runs the instructions through every
+// engine and storage there is and shows the time, how many bytes the row ops
+// and counts went through, and the most grid memory it had at any one time.
+// The u8 lights run out at 255 so they're only right for small inputs, which
+// the warning will point out.
+//
+// Update: no instruction ever does anything to one row because of another
+// row, so the grids split into bands of rows with a thread each ('-t', one per
+// core by default). Every thread goes through all the instructions, clipped to
+// its own rows, and nothing is shared so nothing needs a lock. The dense engine
+// counts up each band in its thread too, and the totals just get added. The
+// compressed engine turns its instructions into block rows and columns first,
+// then bands those the same way.
+//
+// Update: the dense grids need the whole grid in memory, and the compressed
+// blocks get big when a lot of rectangles all have different edges. The tiled
+// engine, '-m tiled', cuts the grid into 64x64 tiles and only makes the ones
+// something touches. A tile stays a single value until a rectangle only covers
+// part of it, and then it gets its cells. A rectangle that covers all of a
+// tile that has cells doesn't go through them, it just adds to the tile's
+// pending transform: (x & ~clear) ^ flip for part 1, max(x + add, floor) for
+// part 2. Two of those in a row are still one of those, so it never grows, and
+// it only gets pushed into the cells when the next partial rectangle comes
+// along or at the count. It has its own storage, bits and u16 lights.
+//
+// Update: giving a partly covered tile all of its cells was the mistake. Big
+// random rectangles leave an edge through nearly every tile they stop in, and
+// 300 of them on a 100000x100000 grid peaked at 4.7GB. Now a tile only cuts
+// itself where an edge goes through it and keeps a value per block, like a
+// tiny compressed grid, so an edge costs a few bytes and the same input peaks
+// at 147MB, most of that the tile headers for everything touched. A tile that
+// a lot of edges go through can still end up with a block per cell.
+//
+// Update: all of the engines only know the answer once the last instruction is
+// done, and something watching a long feed of them wants it after every one.
+// The stream engine, '-m stream', keeps the grid as bands of rows that have
+// had exactly the same things done to them, split whenever an instruction
+// starts or ends inside one. Each band has a segment tree over its columns,
+// and a band's share of the totals is just its tree's times its height, so an
+// instruction only has to update the trees of the bands it covers. Part 1's
+// tree has a pending flip, and on or off over a whole node just throws its
+// children away. Part 2's has a pending add, and off is an add of -1 followed
+// by bumping anything under 0 back up to 0, which is the 'segment tree beats'
+// trick: a node knows its smallest value, how many have it, and the next
+// smallest, so it can fix up just the smallest ones without going any deeper,
+// as long as 0 is in between. Splitting a band shares the trees, and they get
+// copied one node at a time as the halves start to differ. It runs on the
+// instructions as they're read and prints the totals after each one.
+//
+// Update: the bands are only a win on huge grids that the instructions leave
+// mostly alone. Every instruction updates a tree in every band it crosses, and
+// on the plain 1000x1000 grid 5000 random ones cut it into so many bands that
+// the feed took 19 seconds and 155mb. Grids up to 4M lights now stream through
+// dense grids instead, and each instruction moves the totals by the difference
+// it made to just its own rows. The same feed takes 1.3 seconds in 11mb.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/param.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
 
 char *trim(char *str) {
     char *p = str + (strlen(str) - 1);
@@ -44,11 +131,12 @@ char *trim(char *str) {
 #define WIDTH   1000
 #define HEIGHT  1000
 
-#define LIGHT_TYPE(x)   \
-typedef x light; \
-const char *light_type_name = #x
+int width = WIDTH;
+int height = HEIGHT;
+
+#define MAX_THREADS     64
 
-LIGHT_TYPE(double);
+int thread_count = 1;
 
 typedef enum {
     op_ON,
@@ -94,102 +182,1310 @@ operation parse_operation(const char *str) {
     return o;
 }
 
-int count_lights_brightness(light *lights) {
-    light *p = lights;
-    int bright = 0;
-    light *end = lights + (WIDTH * HEIGHT);
+// Both grids are rows of lights in one block, and a storage knows how big a
+// row is and how to do an op to columns first ... last of one (inclusive, same
+// as the puzzle's rectangles). Ops say how many bytes they went through, and
+// total() adds up a whole grid: lights on for part 1, brightness for part 2.
+typedef struct {
+    const char *name;
+    unsigned long max;
+    size_t (*row_bytes)(int columns);
+    size_t (*apply_row)(OPCODE o, void *row, int first, int last);
+    long (*total)(const void *lights, size_t bytes);
+    long (*light_at)(const void *row, int column);
+} storage;
 
-    while (p < end) {
-        bright += *p++;
-    }
+// Part 1 as bits, with each row starting on a fresh word.
+typedef uint64_t bits;
+
+#define BITS_PER_WORD   64
+
+size_t bits_row_bytes(int columns) {
+    return (columns + BITS_PER_WORD - 1) / BITS_PER_WORD * sizeof(bits);
+}
 
-    return bright;
+static inline void apply_bits_op_to_word(OPCODE o, bits *word, bits mask) {
+    if (o == op_ON)
+        *word |= mask;
+    else if (o == op_OFF)
+        *word &= ~mask;
+    else if (o == op_TOGGLE)
+        *word ^= mask;
 }
 
-int count_lights_on(light *lights) {
-    light *p = lights;
-    int count = 0;
-    light *end = lights + (WIDTH * HEIGHT);
+size_t bits_apply_row(OPCODE o, void *lights, int first, int last) {
+    bits *row = lights;
+    size_t first_word = first / BITS_PER_WORD, last_word = last / BITS_PER_WORD;
+    bits first_mask = ~(bits)0 << (first % BITS_PER_WORD);
+    bits last_mask = ~(bits)0 >> (BITS_PER_WORD - 1 - last % BITS_PER_WORD);
 
-    while (p < end) {
-        if (*p++)
-            count++;
+    if (first_word == last_word) {
+        apply_bits_op_to_word(o, row + first_word, first_mask & last_mask);
+        return sizeof(bits);
     }
+
+    apply_bits_op_to_word(o, row + first_word, first_mask);
+    for (size_t i = first_word + 1; i < last_word; i++)
+        apply_bits_op_to_word(o, row + i, ~(bits)0);
+    apply_bits_op_to_word(o, row + last_word, last_mask);
+
+    return (last_word - first_word + 1) * sizeof(bits);
+}
+
+long bits_total(const void *lights, size_t bytes) {
+    const bits *words = lights;
+    long count = 0;
+
+    for (size_t i = 0; i < bytes / sizeof(bits); i++)
+        count += __builtin_popcountll(words[i]);
+
     return count;
 }
 
-void apply_binary_op_to_row(OPCODE o, light *start, size_t count) {
-    light *p = start;
+long bits_light_at(const void *row, int column) {
+    return ((const bits *)row)[column / BITS_PER_WORD] >> (column % BITS_PER_WORD) & 1;
+}
 
-    if (o == op_OFF)
-        memset(start, 0, count * sizeof(light));
-    else if (o == op_ON)
-        while (p < start + count) {
-            *p++ = 1;
-        }
+// Lights a vector at a time. The rows start anywhere, so they can't promise
+// more alignment than a single light.
+#define VECTOR_BYTES    32
+
+// A true comparison is all ones in a vector but just 1 in a scalar, so each
+// side says how it makes a mask out of one.
+#define VECTOR_MASK(T, x)   ((T)(x))
+#define SCALAR_MASK(T, x)   ((T)-(x))
+
+#define DIM_OFF(T, mask, v, r)      r = v + mask(T, v != 0)
+#define DIM_ON(T, mask, v, r)       r = v + 1; r |= mask(T, r < v)
+#define DIM_TOGGLE(T, mask, v, r)   r = v + 2; r |= mask(T, r < v)
+
+// Each kernel is the whole vectors and then the leftovers one light at a time,
+// with the same arithmetic.
+#define DEFINE_DIMMABLE_KERNEL(name, T, V, step) \
+static void name(T *start, size_t count) { \
+    T *p = start; \
+    T *end = start + count; \
+    for (; end - p >= (long)(sizeof(V) / sizeof(T)); p += sizeof(V) / sizeof(T)) { \
+        V v = *(V *)p, r; \
+        step(V, VECTOR_MASK, v, r); \
+        *(V *)p = r; \
+    } \
+    for (; p < end; p++) { \
+        T v = *p, r; \
+        step(T, SCALAR_MASK, v, r); \
+        *p = r; \
+    } \
+}
+
+// Part 2 as lights of type T, which add up in lanes of type W, wide enough that
+// they only need folding into the total every so often.
+#define DEFINE_DIMMABLE_STORAGE(name, T, W) \
+typedef T name##_vec __attribute__((vector_size(VECTOR_BYTES), aligned(sizeof(T)))); \
+typedef W name##_wide __attribute__((vector_size(VECTOR_BYTES / sizeof(T) * sizeof(W)))); \
+\
+DEFINE_DIMMABLE_KERNEL(name##_off_row, T, name##_vec, DIM_OFF) \
+DEFINE_DIMMABLE_KERNEL(name##_on_row, T, name##_vec, DIM_ON) \
+DEFINE_DIMMABLE_KERNEL(name##_toggle_row, T, name##_vec, DIM_TOGGLE) \
+\
+size_t name##_row_bytes(int columns) { \
+    return columns * sizeof(T); \
+} \
+\
+size_t name##_apply_row(OPCODE o, void *row, int first, int last) { \
+    T *start = (T *)row + first; \
+    size_t count = last - first + 1; \
+    if (o == op_ON) \
+        name##_on_row(start, count); \
+    else if (o == op_OFF) \
+        name##_off_row(start, count); \
+    else if (o == op_TOGGLE) \
+        name##_toggle_row(start, count); \
+    return count * sizeof(T); \
+} \
+\
+long name##_total(const void *lights, size_t bytes) { \
+    const T *p = lights; \
+    const T *end = p + bytes / sizeof(T); \
+    const size_t lanes = VECTOR_BYTES / sizeof(T); \
+    const size_t flush = (W)~(W)0 / (T)~(T)0; \
+    long total = 0; \
+    while ((size_t)(end - p) >= lanes) { \
+        name##_wide sum = { 0 }; \
+        for (size_t n = 0; n < flush && (size_t)(end - p) >= lanes; n++, p += lanes) \
+            sum += __builtin_convertvector(*(name##_vec *)p, name##_wide); \
+        for (size_t i = 0; i < lanes; i++) \
+            total += sum[i]; \
+    } \
+    while (p < end) \
+        total += *p++; \
+    return total; \
+} \
+\
+long name##_light_at(const void *row, int column) { \
+    return ((const T *)row)[column]; \
+}
+
+DEFINE_DIMMABLE_STORAGE(u8, uint8_t, uint32_t)
+DEFINE_DIMMABLE_STORAGE(u16, uint16_t, uint32_t)
+DEFINE_DIMMABLE_STORAGE(u32, uint32_t, uint64_t)
+DEFINE_DIMMABLE_STORAGE(u64, uint64_t, uint64_t)
+
+// Part 1 as a byte per light, which adds up the same as u8 lights do.
+size_t bytes_apply_row(OPCODE o, void *row, int first, int last) {
+    uint8_t *p = (uint8_t *)row + first;
+    size_t count = last - first + 1;
+
+    if (o == op_ON)
+        memset(p, 1, count);
+    else if (o == op_OFF)
+        memset(p, 0, count);
     else if (o == op_TOGGLE) {
-        while (p < start + count) {
-            *p = !*p;
-            p++;
-        }
+        for (size_t i = 0; i < count; i++)
+            p[i] ^= 1;
     }
+    return count;
 }
 
-void apply_dimmable_op_to_row(OPCODE o, light *start, size_t count) {
-    light *p = start;
+const storage binary_storages[] = {
+    { "bits", 1, bits_row_bytes, bits_apply_row, bits_total, bits_light_at },
+    { "bytes", 1, u8_row_bytes, bytes_apply_row, u8_total, u8_light_at },
+};
+
+const storage dimmable_storages[] = {
+    { "u8", UINT8_MAX, u8_row_bytes, u8_apply_row, u8_total, u8_light_at },
+    { "u16", UINT16_MAX, u16_row_bytes, u16_apply_row, u16_total, u16_light_at },
+    { "u32", UINT32_MAX, u32_row_bytes, u32_apply_row, u32_total, u32_light_at },
+    { "u64", UINT64_MAX, u64_row_bytes, u64_apply_row, u64_total, u64_light_at },
+};
 
-    while (p < start + count) {
-        if (o == op_ON)
-            *p += 1;
-        else if (o == op_OFF && *p > 0)
-            *p -= 1;
-        else if (o == op_TOGGLE)
-            *p += 2;
+#define BINARY_STORAGE_COUNT    (int)(sizeof(binary_storages) / sizeof(storage))
+#define DIMMABLE_STORAGE_COUNT  (int)(sizeof(dimmable_storages) / sizeof(storage))
 
-        p++;
+const storage *select_storage(const storage *storages, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(storages[i].name, name) == 0)
+            return storages + i;
     }
+    fprintf(stderr, "error: unknown storage '%s'.\n", name);
+    return NULL;
 }
 
-void apply_operation(operation o, light *binary, light *dimmable) {
-    int length = o.d - o.b + 1;
+// What the benchmark reports, kept up to date by the engines.
+long bytes_touched = 0;
+size_t grid_bytes = 0;
+size_t peak_grid_bytes = 0;
 
-    for (int i = o.a; i <= o.c; i++ ) {
-        int rowstart = i * WIDTH;
-        apply_binary_op_to_row(o.op, binary + rowstart + o.b, length);
-        apply_dimmable_op_to_row(o.op, dimmable + rowstart + o.b, length);
+void *grid_alloc(size_t bytes) {
+    void *p = calloc(bytes, 1);
+    if (p) {
+        grid_bytes += bytes;
+        peak_grid_bytes = MAX(peak_grid_bytes, grid_bytes);
     }
+    return p;
 }
 
-void dump_operation(operation o) {
-    printf("%s %d,%d through %d,%d\n", o.thunk, o.a, o.b, o.c, o.d);
+void grid_free(void *p, size_t bytes) {
+    if (p)
+        grid_bytes -= bytes;
+    free(p);
 }
 
-int main(int argc, char **argv) {
-    light *binary = calloc(WIDTH * HEIGHT, sizeof(light));
+typedef struct {
+    long on;
+    long brightness;
+} light_totals;
+
+typedef struct {
+    const storage *binary;
+    const storage *dimmable;
+} light_storage;
+
+// A band is rows first_row ... last_row - 1 of both grids, all one thread's.
+typedef struct {
+    operation *ops;
+    int count;
+    light_storage lights;
+    char *binary;
+    char *dimmable;
+    size_t binary_row;
+    size_t dimmable_row;
+    int first_row;
+    int last_row;
+    bool count_totals;
+    long touched;
+    light_totals totals;
+} band;
+
+void *run_band(void *arg) {
+    band *b = arg;
+
+    b->touched = 0;
+    for (int i = 0; i < b->count; i++) {
+        operation o = b->ops[i];
+        int first = MAX(o.a, b->first_row), last = MIN(o.c, b->last_row - 1);
+
+        for (int r = first; r <= last; r++) {
+            b->touched += b->lights.binary->apply_row(o.op, b->binary + r * b->binary_row, o.b, o.d);
+            b->touched += b->lights.dimmable->apply_row(o.op, b->dimmable + r * b->dimmable_row, o.b, o.d);
+        }
+    }
+
+    if (b->count_totals) {
+        int rows = b->last_row - b->first_row;
+        b->totals.on = b->lights.binary->total(b->binary + b->first_row * b->binary_row, rows * b->binary_row);
+        b->totals.brightness = b->lights.dimmable->total(b->dimmable + b->first_row * b->dimmable_row, rows * b->dimmable_row);
+        b->touched += rows * (b->binary_row + b->dimmable_row);
+    }
+    return NULL;
+}
+
+// Runs every op over rows 0 ... rows - 1 of the grids, a band per thread, and
+// adds up the bands' totals if it's asked to.
+void apply_in_bands(operation *ops, int count, light_storage lights, char *binary, size_t binary_row,
+        char *dimmable, size_t dimmable_row, int rows, light_totals *totals) {
+    pthread_t threads[MAX_THREADS];
+    band bands[MAX_THREADS];
+    int bands_used = MAX(1, MIN(MIN(thread_count, MAX_THREADS), rows));
+
+    for (int t = 0; t < bands_used; t++) {
+        band *b = &bands[t];
+        b->ops = ops;
+        b->count = count;
+        b->lights = lights;
+        b->binary = binary;
+        b->dimmable = dimmable;
+        b->binary_row = binary_row;
+        b->dimmable_row = dimmable_row;
+        b->first_row = (int)((long)rows * t / bands_used);
+        b->last_row = (int)((long)rows * (t + 1) / bands_used);
+        b->count_totals = totals != NULL;
+    }
+    for (int t = 1; t < bands_used; t++)
+        pthread_create(&threads[t], NULL, run_band, &bands[t]);
+    run_band(&bands[0]);
+    for (int t = 1; t < bands_used; t++)
+        pthread_join(threads[t], NULL);
+
+    if (totals) {
+        totals->on = 0;
+        totals->brightness = 0;
+    }
+    for (int t = 0; t < bands_used; t++) {
+        bytes_touched += bands[t].touched;
+        if (totals) {
+            totals->on += bands[t].totals.on;
+            totals->brightness += bands[t].totals.brightness;
+        }
+    }
+}
+
+// the original, a light per cell in both grids
+bool run_dense(operation *ops, int count, light_storage lights, light_totals *totals) {
+    size_t binary_row = lights.binary->row_bytes(width);
+    size_t dimmable_row = lights.dimmable->row_bytes(width);
+
+    char *binary = grid_alloc(binary_row * height);
     if (!binary) {
         fprintf(stderr, "error: cannot allocate memory for the binary array.\n");
+        return false;
     }
 
-    light *dimmable = calloc(WIDTH * HEIGHT, sizeof(light));
+    char *dimmable = grid_alloc(dimmable_row * height);
     if (!dimmable) {
         fprintf(stderr, "error: cannot allocate memory for the dimmable array.\n");
+        grid_free(binary, binary_row * height);
+        return false;
+    }
+
+    apply_in_bands(ops, count, lights, binary, binary_row, dimmable, dimmable_row, height, totals);
+
+    grid_free(binary, binary_row * height);
+    grid_free(dimmable, dimmable_row * height);
+    return true;
+}
+
+int compare_ints(const void *a, const void *b) {
+    return (*(int *)a > *(int *)b) - (*(int *)a < *(int *)b);
+}
+
+// sorts the edges and drops the repeats, returning how many are left
+int compress_edges(int *edges, int count) {
+    int unique = 0;
+
+    qsort(edges, count, sizeof(int), compare_ints);
+    for (int i = 0; i < count; i++) {
+        if (unique == 0 || edges[unique - 1] != edges[i])
+            edges[unique++] = edges[i];
+    }
+    return unique;
+}
+
+// where an edge is in the compressed ones, which it's known to be in
+int edge_index(int *edges, int count, int edge) {
+    int low = 0, high = count - 1;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (edges[mid] < edge)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// Block (r, c) is rows rows[r] ... rows[r + 1] - 1 by columns cols[c] ...
+// cols[c + 1] - 1. The rectangles start on an edge and end just before one, so
+// each covers whole blocks, and a row of blocks gets the same row ops as cells.
+bool run_compressed(operation *ops, int count, light_storage lights, light_totals *totals) {
+    size_t edge_bytes = 2 * count * sizeof(int), block_op_bytes = count * sizeof(operation);
+    int *rows = grid_alloc(edge_bytes);
+    int *cols = grid_alloc(edge_bytes);
+    operation *block_ops = grid_alloc(block_op_bytes);
+    if (!rows || !cols || !block_ops) {
+        fprintf(stderr, "error: cannot allocate memory for the edges.\n");
+        grid_free(rows, edge_bytes);
+        grid_free(cols, edge_bytes);
+        grid_free(block_ops, block_op_bytes);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        rows[2 * i] = ops[i].a;
+        rows[2 * i + 1] = ops[i].c + 1;
+        cols[2 * i] = ops[i].b;
+        cols[2 * i + 1] = ops[i].d + 1;
+    }
+    int row_edges = compress_edges(rows, 2 * count);
+    int col_edges = compress_edges(cols, 2 * count);
+    int block_rows = MAX(row_edges - 1, 0), block_cols = MAX(col_edges - 1, 0);
+
+    size_t binary_row = lights.binary->row_bytes(block_cols);
+    size_t dimmable_row = lights.dimmable->row_bytes(block_cols);
+    size_t binary_bytes = binary_row * block_rows + 1, dimmable_bytes = dimmable_row * block_rows + 1;
+    char *binary = grid_alloc(binary_bytes);
+    char *dimmable = grid_alloc(dimmable_bytes);
+    if (!binary || !dimmable) {
+        fprintf(stderr, "error: cannot allocate memory for %d x %d blocks.\n", block_rows, block_cols);
+        grid_free(rows, edge_bytes);
+        grid_free(cols, edge_bytes);
+        grid_free(block_ops, block_op_bytes);
+        grid_free(binary, binary_bytes);
+        grid_free(dimmable, dimmable_bytes);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        operation *o = &block_ops[i];
+        *o = ops[i];
+        o->a = edge_index(rows, row_edges, ops[i].a);
+        o->c = edge_index(rows, row_edges, ops[i].c + 1) - 1;
+        o->b = edge_index(cols, col_edges, ops[i].b);
+        o->d = edge_index(cols, col_edges, ops[i].d + 1) - 1;
+    }
+    apply_in_bands(block_ops, count, lights, binary, binary_row, dimmable, dimmable_row, block_rows, NULL);
+
+    totals->on = 0;
+    totals->brightness = 0;
+    for (int r = 0; r < block_rows; r++) {
+        for (int c = 0; c < block_cols; c++) {
+            long area = (long)(rows[r + 1] - rows[r]) * (cols[c + 1] - cols[c]);
+            totals->on += lights.binary->light_at(binary + r * binary_row, c) * area;
+            totals->brightness += lights.dimmable->light_at(dimmable + r * dimmable_row, c) * area;
+        }
+    }
+    bytes_touched += (binary_row + dimmable_row) * block_rows;
+
+    grid_free(rows, edge_bytes);
+    grid_free(cols, edge_bytes);
+    grid_free(block_ops, block_op_bytes);
+    grid_free(binary, binary_bytes);
+    grid_free(dimmable, dimmable_bytes);
+    return true;
+}
+
+// A tile is a little compressed grid of its own: row_cuts has bit r set when a
+// block of rows starts at row r, col_cuts the same for columns, and each block
+// has one value, in rows of blocks. Bit 0 is always a cut, so it's never
+// stored, and a tile nothing has cut is a single block held right in the tile.
+// A rectangle edge through a tile costs it one more row or column of blocks,
+// not its cells. Lights are u16 like the usual ones. All zeros is an untouched
+// tile, all off with nothing pending.
+#define TILE_SIZE   64
+
+typedef uint64_t cuts;
+
+typedef struct {
+    cuts row_cuts, col_cuts;
+    uint8_t *binary;            // a value per block, or NULL while it's one block
+    uint16_t *dimmable;
+    uint16_t dimmable_value;    // the one block's values
+    uint8_t binary_value;
+    uint8_t clear, flip;        // pending on binary: x = (x & ~clear) ^ flip
+    int32_t add, floor;         // pending on dimmable: x = max(x + add, floor)
+} tile;
+
+typedef struct {
+    int wide, high;
+    tile **rows;                // a row of tiles, or NULL until something touches it
+} tile_grid;
+
+// what each op does to a whole tile, as a transform
+void op_transform(OPCODE o, uint8_t *clear, uint8_t *flip, int32_t *add) {
+    *clear = o != op_TOGGLE;
+    *flip = o != op_OFF;
+    *add = o == op_ON ? 1 : o == op_OFF ? -1 : 2;
+}
+
+static inline uint16_t dim_transform(long x, long add, long floor) {
+    return MIN(MAX(x + add, floor), UINT16_MAX);
+}
+
+static inline int cut_count(cuts c) {
+    return __builtin_popcountll(c | 1);
+}
+
+// the block that row or column i of a tile is in
+static inline int block_of(cuts c, int i) {
+    cuts upto = i == TILE_SIZE - 1 ? ~(cuts)0 : ((cuts)2 << i) - 1;
+    return __builtin_popcountll((c | 1) & upto) - 1;
+}
+
+// where each block starts, with one more entry for the end of the tile
+static int cut_starts(cuts c, int *starts) {
+    int n = 0;
+    for (c |= 1; c; c &= c - 1)
+        starts[n++] = __builtin_ctzll(c);
+    starts[n] = TILE_SIZE;
+    return n;
+}
+
+static inline size_t tile_blocks(const tile *t) {
+    return (size_t)cut_count(t->row_cuts) * cut_count(t->col_cuts);
+}
+
+// pending transforms go into the blocks, leaving nothing pending
+void flush_tile(tile *t) {
+    size_t blocks = tile_blocks(t);
+
+    if (t->binary && (t->clear || t->flip)) {
+        for (size_t i = 0; i < blocks; i++)
+            t->binary[i] = (t->binary[i] & ~t->clear) ^ t->flip;
+        bytes_touched += blocks;
+    }
+    t->clear = t->flip = 0;
+
+    if (t->dimmable && (t->add || t->floor)) {
+        for (size_t i = 0; i < blocks; i++)
+            t->dimmable[i] = dim_transform(t->dimmable[i], t->add, t->floor);
+        bytes_touched += blocks * sizeof(uint16_t);
+    }
+    t->add = t->floor = 0;
+}
+
+// Adds the cuts, copying each new block from the old one it was part of. A
+// tile that was one block gets its arrays here.
+bool cut_tile(tile *t, cuts row_cuts, cuts col_cuts) {
+    row_cuts |= t->row_cuts;
+    col_cuts |= t->col_cuts;
+    if (t->binary && row_cuts == t->row_cuts && col_cuts == t->col_cuts)
+        return true;
+
+    int row_starts[TILE_SIZE + 1], col_starts[TILE_SIZE + 1];
+    int block_rows = cut_starts(row_cuts, row_starts);
+    int block_cols = cut_starts(col_cuts, col_starts);
+    size_t blocks = (size_t)block_rows * block_cols;
+    uint8_t *binary = grid_alloc(blocks);
+    uint16_t *dimmable = grid_alloc(blocks * sizeof(uint16_t));
+
+    if (!binary || !dimmable) {
+        grid_free(binary, blocks);
+        grid_free(dimmable, blocks * sizeof(uint16_t));
+        return false;
+    }
+
+    int old_cols = cut_count(t->col_cuts);
+    for (int r = 0; r < block_rows; r++) {
+        int from_row = block_of(t->row_cuts, row_starts[r]);
+        for (int c = 0; c < block_cols; c++) {
+            size_t from = (size_t)from_row * old_cols + block_of(t->col_cuts, col_starts[c]);
+            binary[r * block_cols + c] = t->binary ? t->binary[from] : t->binary_value;
+            dimmable[r * block_cols + c] = t->dimmable ? t->dimmable[from] : t->dimmable_value;
+        }
+    }
+    bytes_touched += blocks * (1 + sizeof(uint16_t));
+
+    size_t old_blocks = tile_blocks(t);
+    grid_free(t->binary, old_blocks);
+    grid_free(t->dimmable, old_blocks * sizeof(uint16_t));
+    t->binary = binary;
+    t->dimmable = dimmable;
+    t->row_cuts = row_cuts & ~(cuts)1;
+    t->col_cuts = col_cuts & ~(cuts)1;
+    return true;
+}
+
+// the cuts a rectangle from first to last needs, inside a tile
+static inline cuts edges(int first, int last) {
+    return (cuts)1 << first | (last < TILE_SIZE - 1 ? (cuts)1 << (last + 1) : 0);
+}
+
+// Rows first_row ... last_row and columns first_col ... last_col, all inside
+// the tile, which is all of it if they cover every cell of it that's on the
+// grid. Blocks past the grid's edge are never counted.
+bool apply_to_tile(OPCODE o, tile *t, int first_row, int last_row, int first_col, int last_col, bool whole) {
+    uint8_t clear, flip;
+    int32_t add;
+
+    op_transform(o, &clear, &flip, &add);
+
+    if (whole && !t->binary) {
+        t->binary_value = (t->binary_value & ~clear) ^ flip;
+        t->dimmable_value = dim_transform(t->dimmable_value, add, 0);
+        bytes_touched += sizeof(tile);
+        return true;
+    }
+    if (whole) {
+        t->clear |= clear;
+        t->flip = (t->flip & ~clear) ^ flip;
+        t->floor = MAX(t->floor + add, 0);
+        t->add += add;
+        bytes_touched += sizeof(tile);
+        return true;
+    }
+
+    flush_tile(t);
+    if (!cut_tile(t, edges(first_row, last_row), edges(first_col, last_col)))
+        return false;
+
+    int block_cols = cut_count(t->col_cuts);
+    int first = block_of(t->col_cuts, first_col), last = block_of(t->col_cuts, last_col);
+    for (int r = block_of(t->row_cuts, first_row); r <= block_of(t->row_cuts, last_row); r++) {
+        bytes_touched += bytes_apply_row(o, t->binary + r * block_cols, first, last);
+        bytes_touched += u16_apply_row(o, t->dimmable + r * block_cols, first, last);
+    }
+    return true;
+}
+
+bool apply_to_tiles(tile_grid *g, operation o) {
+    for (int ty = o.a / TILE_SIZE; ty <= o.c / TILE_SIZE; ty++) {
+        if (!g->rows[ty] && !(g->rows[ty] = grid_alloc(g->wide * sizeof(tile))))
+            return false;
+
+        int top = ty * TILE_SIZE, rows = MIN(TILE_SIZE, height - top);
+        int first_row = MAX(o.a - top, 0), last_row = MIN(o.c - top, TILE_SIZE - 1);
+
+        for (int tx = o.b / TILE_SIZE; tx <= o.d / TILE_SIZE; tx++) {
+            int left = tx * TILE_SIZE, cols = MIN(TILE_SIZE, width - left);
+            int first_col = MAX(o.b - left, 0), last_col = MIN(o.d - left, TILE_SIZE - 1);
+            bool whole = first_row == 0 && last_row >= rows - 1 && first_col == 0 && last_col >= cols - 1;
+
+            if (!apply_to_tile(o.op, &g->rows[ty][tx], first_row, last_row, first_col, last_col, whole))
+                return false;
+        }
+    }
+    return true;
+}
+
+// counts the on-grid cells of a tile, with anything pending applied on the way
+void count_tile(tile *t, int rows, int cols, light_totals *totals) {
+    if (!t->binary) {
+        totals->on += t->binary_value * (long)rows * cols;
+        totals->brightness += t->dimmable_value * (long)rows * cols;
+        return;
+    }
+
+    int row_starts[TILE_SIZE + 1], col_starts[TILE_SIZE + 1];
+    int block_rows = cut_starts(t->row_cuts, row_starts);
+    int block_cols = cut_starts(t->col_cuts, col_starts);
+
+    for (int r = 0; r < block_rows && row_starts[r] < rows; r++) {
+        long high = MIN(row_starts[r + 1], rows) - row_starts[r];
+        for (int c = 0; c < block_cols && col_starts[c] < cols; c++) {
+            long area = high * (MIN(col_starts[c + 1], cols) - col_starts[c]);
+            int i = r * block_cols + c;
+            totals->on += ((t->binary[i] & ~t->clear) ^ t->flip) * area;
+            totals->brightness += dim_transform(t->dimmable[i], t->add, t->floor) * area;
+        }
+    }
+    bytes_touched += tile_blocks(t) * (1 + sizeof(uint16_t));
+}
+
+void free_tiles(tile_grid *g) {
+    for (int ty = 0; ty < g->high; ty++) {
+        if (!g->rows[ty])
+            continue;
+        for (int tx = 0; tx < g->wide; tx++) {
+            tile *t = &g->rows[ty][tx];
+            grid_free(t->binary, tile_blocks(t));
+            grid_free(t->dimmable, tile_blocks(t) * sizeof(uint16_t));
+        }
+        grid_free(g->rows[ty], g->wide * sizeof(tile));
+    }
+    grid_free(g->rows, g->high * sizeof(tile *));
+}
+
+// The tiles have their own storage, so the one picked with -b and -d isn't used.
+bool run_tiled(operation *ops, int count, light_storage lights, light_totals *totals) {
+    tile_grid g;
+
+    (void)lights;
+
+    g.wide = (width + TILE_SIZE - 1) / TILE_SIZE;
+    g.high = (height + TILE_SIZE - 1) / TILE_SIZE;
+    g.rows = grid_alloc(g.high * sizeof(tile *));
+    if (!g.rows) {
+        fprintf(stderr, "error: cannot allocate memory for %d rows of tiles.\n", g.high);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!apply_to_tiles(&g, ops[i])) {
+            fprintf(stderr, "error: cannot allocate memory for more tiles.\n");
+            free_tiles(&g);
+            return false;
+        }
+    }
+
+    totals->on = 0;
+    totals->brightness = 0;
+    for (int ty = 0; ty < g.high; ty++) {
+        if (!g.rows[ty])
+            continue;
+        for (int tx = 0; tx < g.wide; tx++) {
+            count_tile(&g.rows[ty][tx], MIN(TILE_SIZE, height - ty * TILE_SIZE),
+                MIN(TILE_SIZE, width - tx * TILE_SIZE), totals);
+        }
     }
 
+    free_tiles(&g);
+    return true;
+}
+
+// Part 1's column tree. A node without children is all on or all off, and
+// a missing node is all off. Nodes can be shared between bands, so anything
+// that changes one makes sure it has its own copy first.
+typedef struct bin_node {
+    int refs;
+    bool flip;              // pending for the children
+    long on;
+    struct bin_node *left, *right;
+} bin_node;
+
+bin_node *bin_alloc(long on) {
+    bin_node *n = grid_alloc(sizeof(bin_node));
+    if (!n) {
+        fprintf(stderr, "error: cannot allocate memory for a column tree.\n");
+        exit(1);
+    }
+    n->refs = 1;
+    n->on = on;
+    return n;
+}
+
+void bin_release(bin_node *n) {
+    if (n && --n->refs == 0) {
+        bin_release(n->left);
+        bin_release(n->right);
+        grid_free(n, sizeof(bin_node));
+    }
+}
+
+bin_node *bin_own(bin_node *n) {
+    bytes_touched += sizeof(bin_node);
+    if (!n)
+        return bin_alloc(0);
+    if (n->refs == 1)
+        return n;
+
+    bin_node *copy = bin_alloc(n->on);
+    copy->flip = n->flip;
+    copy->left = n->left;
+    copy->right = n->right;
+    if (copy->left) {
+        copy->left->refs++;
+        copy->right->refs++;
+    }
+    n->refs--;
+    return copy;
+}
+
+void bin_flip(bin_node *n, long span) {
+    n->on = span - n->on;
+    if (n->left)
+        n->flip = !n->flip;
+}
+
+// columns lo ... hi - 1 are n's, and columns a ... b - 1 get the op
+bin_node *bin_update(bin_node *n, int lo, int hi, int a, int b, OPCODE o) {
+    n = bin_own(n);
+
+    if (a <= lo && hi <= b) {
+        if (o == op_TOGGLE)
+            bin_flip(n, hi - lo);
+        else {
+            bin_release(n->left);
+            bin_release(n->right);
+            n->left = n->right = NULL;
+            n->flip = false;
+            n->on = o == op_ON ? hi - lo : 0;
+        }
+        return n;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    if (!n->left) {
+        n->left = bin_alloc(n->on ? mid - lo : 0);
+        n->right = bin_alloc(n->on ? hi - mid : 0);
+    }
+    else if (n->flip) {
+        n->left = bin_own(n->left);
+        n->right = bin_own(n->right);
+        bin_flip(n->left, mid - lo);
+        bin_flip(n->right, hi - mid);
+        n->flip = false;
+    }
+
+    if (a < mid)
+        n->left = bin_update(n->left, lo, mid, a, b, o);
+    if (b > mid)
+        n->right = bin_update(n->right, mid, hi, a, b, o);
+    n->on = n->left->on + n->right->on;
+    return n;
+}
+
+// Part 2's column tree, the same way, except a node without children has all
+// its lights at min. second is LONG_MAX when there's only the one value.
+typedef struct dim_node {
+    int refs;
+    long min, second;
+    long min_count;
+    long sum;
+    long add;               // pending for the children
+    struct dim_node *left, *right;
+} dim_node;
+
+dim_node *dim_alloc(long value, long span) {
+    dim_node *n = grid_alloc(sizeof(dim_node));
+    if (!n) {
+        fprintf(stderr, "error: cannot allocate memory for a column tree.\n");
+        exit(1);
+    }
+    n->refs = 1;
+    n->min = value;
+    n->second = LONG_MAX;
+    n->min_count = span;
+    n->sum = value * span;
+    return n;
+}
+
+void dim_release(dim_node *n) {
+    if (n && --n->refs == 0) {
+        dim_release(n->left);
+        dim_release(n->right);
+        grid_free(n, sizeof(dim_node));
+    }
+}
+
+dim_node *dim_own(dim_node *n, long span) {
+    bytes_touched += sizeof(dim_node);
+    if (!n)
+        return dim_alloc(0, span);
+    if (n->refs == 1)
+        return n;
+
+    dim_node *copy = dim_alloc(0, 0);
+    *copy = *n;
+    copy->refs = 1;
+    if (copy->left) {
+        copy->left->refs++;
+        copy->right->refs++;
+    }
+    n->refs--;
+    return copy;
+}
+
+void dim_add(dim_node *n, long span, long add) {
+    n->min += add;
+    if (n->second != LONG_MAX)
+        n->second += add;
+    n->sum += add * span;
+    if (n->left)
+        n->add += add;
+}
+
+// only for floor strictly between min and second, when it's just the smallest
+// lights that move
+void dim_raise_min(dim_node *n, long floor) {
+    n->sum += (floor - n->min) * n->min_count;
+    n->min = floor;
+}
+
+void dim_push(dim_node *n, long left_span, long right_span) {
+    if (n->add) {
+        n->left = dim_own(n->left, left_span);
+        n->right = dim_own(n->right, right_span);
+        dim_add(n->left, left_span, n->add);
+        dim_add(n->right, right_span, n->add);
+        n->add = 0;
+    }
+    if (n->left->min < n->min) {
+        n->left = dim_own(n->left, left_span);
+        dim_raise_min(n->left, n->min);
+    }
+    if (n->right->min < n->min) {
+        n->right = dim_own(n->right, right_span);
+        dim_raise_min(n->right, n->min);
+    }
+}
+
+void dim_pull(dim_node *n) {
+    dim_node *l = n->left, *r = n->right;
+
+    if (l->min == r->min) {
+        n->min = l->min;
+        n->min_count = l->min_count + r->min_count;
+        n->second = MIN(l->second, r->second);
+    }
+    else if (l->min < r->min) {
+        n->min = l->min;
+        n->min_count = l->min_count;
+        n->second = MIN(l->second, r->min);
+    }
+    else {
+        n->min = r->min;
+        n->min_count = r->min_count;
+        n->second = MIN(l->min, r->second);
+    }
+    n->sum = l->sum + r->sum;
+}
+
+// every light below 0 goes back up to 0
+dim_node *dim_floor_zero(dim_node *n, int lo, int hi) {
+    if (n->min >= 0)
+        return n;
+    n = dim_own(n, hi - lo);
+    if (n->second > 0) {
+        dim_raise_min(n, 0);
+        return n;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    dim_push(n, mid - lo, hi - mid);
+    n->left = dim_floor_zero(n->left, lo, mid);
+    n->right = dim_floor_zero(n->right, mid, hi);
+    dim_pull(n);
+    return n;
+}
+
+dim_node *dim_update(dim_node *n, int lo, int hi, int a, int b, OPCODE o) {
+    n = dim_own(n, hi - lo);
+
+    if (a <= lo && hi <= b) {
+        dim_add(n, hi - lo, o == op_ON ? 1 : o == op_OFF ? -1 : 2);
+        return o == op_OFF ? dim_floor_zero(n, lo, hi) : n;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    if (!n->left) {
+        n->left = dim_alloc(n->min, mid - lo);
+        n->right = dim_alloc(n->min, hi - mid);
+    }
+    else
+        dim_push(n, mid - lo, hi - mid);
+
+    if (a < mid)
+        n->left = dim_update(n->left, lo, mid, a, b, o);
+    if (b > mid)
+        n->right = dim_update(n->right, mid, hi, a, b, o);
+    dim_pull(n);
+    return n;
+}
+
+// Rows top ... top + rows - 1, which have all had the same ops.
+typedef struct {
+    int top, rows;
+    bin_node *binary;
+    dim_node *dimmable;
+} row_band;
+
+// Grids up to this many lights stream through plain dense grids instead, see
+// stream_init.
+#define STREAM_DENSE_LIGHTS     (1 << 22)
+
+typedef struct {
+    int count, capacity;
+    row_band *bands;
+    bits *binary;               // the dense grids, or NULL when it's bands
+    uint32_t *dimmable;
+    size_t binary_row;
+    light_totals totals;
+} stream;
+
+#define band_on(b)          ((b)->binary ? (b)->binary->on * (b)->rows : 0)
+#define band_brightness(b)  ((b)->dimmable ? (b)->dimmable->sum * (b)->rows : 0)
+
+// The bands only pay off on huge grids that most instructions leave alone. On
+// a small one every instruction crosses most of the bands, and a dense grid
+// whose totals move by what each instruction's rows did is a lot cheaper.
+// Its lights are u32 so nothing a feed could do in practice saturates them.
+void stream_init(stream *s) {
+    s->totals.on = 0;
+    s->totals.brightness = 0;
+    s->count = s->capacity = 0;
+    s->bands = NULL;
+    s->binary = NULL;
+    s->dimmable = NULL;
+
+    if ((long)width * height <= STREAM_DENSE_LIGHTS) {
+        s->binary_row = bits_row_bytes(width);
+        s->binary = grid_alloc(s->binary_row * height);
+        s->dimmable = grid_alloc(u32_row_bytes(width) * height);
+        if (!s->binary || !s->dimmable) {
+            fprintf(stderr, "error: cannot allocate memory for the %dx%d grid.\n", width, height);
+            exit(1);
+        }
+        return;
+    }
+
+    s->count = 1;
+    s->capacity = 16;
+    s->bands = grid_alloc(s->capacity * sizeof(row_band));
+    if (!s->bands) {
+        fprintf(stderr, "error: cannot allocate memory for the row bands.\n");
+        exit(1);
+    }
+    s->bands[0].rows = height;
+}
+
+void stream_free(stream *s) {
+    for (int i = 0; i < s->count; i++) {
+        bin_release(s->bands[i].binary);
+        dim_release(s->bands[i].dimmable);
+    }
+    grid_free(s->bands, s->capacity * sizeof(row_band));
+    grid_free(s->binary, s->binary_row * height);
+    grid_free(s->dimmable, u32_row_bytes(width) * height);
+}
+
+// the band that has row in it
+int find_band(stream *s, int row) {
+    int low = 0, high = s->count - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (s->bands[mid].top <= row)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return low;
+}
+
+// makes row the top of a band, if it isn't already
+void split_band(stream *s, int row) {
+    if (row >= height)
+        return;
+
+    int i = find_band(s, row);
+    row_band *b = &s->bands[i];
+    if (b->top == row)
+        return;
+
+    if (s->count == s->capacity) {
+        row_band *bands = grid_alloc(2 * s->capacity * sizeof(row_band));
+        if (!bands) {
+            fprintf(stderr, "error: cannot allocate memory for %d row bands.\n", 2 * s->capacity);
+            exit(1);
+        }
+        memcpy(bands, s->bands, s->count * sizeof(row_band));
+        grid_free(s->bands, s->capacity * sizeof(row_band));
+        s->bands = bands;
+        s->capacity *= 2;
+        b = &s->bands[i];
+    }
+
+    memmove(b + 2, b + 1, (s->count - i - 1) * sizeof(row_band));
+    s->count++;
+    b[1] = b[0];
+    b[1].top = row;
+    b[1].rows = b->top + b->rows - row;
+    b->rows = row - b->top;
+    if (b->binary)
+        b->binary->refs++;
+    if (b->dimmable)
+        b->dimmable->refs++;
+}
+
+// each row's share of the totals comes out before the op and goes back in
+// after, counting only the words and lights the op could change
+void stream_apply_dense(stream *s, operation o) {
+    size_t first_word = o.b / BITS_PER_WORD;
+    size_t word_bytes = (o.d / BITS_PER_WORD - first_word + 1) * sizeof(bits);
+    size_t light_bytes = u32_row_bytes(o.d - o.b + 1);
+
+    for (int r = o.a; r <= o.c; r++) {
+        bits *binary = (bits *)((char *)s->binary + r * s->binary_row);
+        uint32_t *dimmable = s->dimmable + (size_t)r * width;
+
+        s->totals.on -= bits_total(binary + first_word, word_bytes);
+        bytes_touched += bits_apply_row(o.op, binary, o.b, o.d);
+        s->totals.on += bits_total(binary + first_word, word_bytes);
+
+        s->totals.brightness -= u32_total(dimmable + o.b, light_bytes);
+        bytes_touched += u32_apply_row(o.op, dimmable, o.b, o.d);
+        s->totals.brightness += u32_total(dimmable + o.b, light_bytes);
+    }
+    bytes_touched += (word_bytes + light_bytes) * 2 * (o.c - o.a + 1);
+}
+
+void stream_apply(stream *s, operation o) {
+    if (s->binary) {
+        stream_apply_dense(s, o);
+        return;
+    }
+
+    split_band(s, o.a);
+    split_band(s, o.c + 1);
+
+    for (int i = find_band(s, o.a); i < s->count && s->bands[i].top <= o.c; i++) {
+        row_band *b = &s->bands[i];
+
+        s->totals.on -= band_on(b);
+        s->totals.brightness -= band_brightness(b);
+        b->binary = bin_update(b->binary, 0, width, o.b, o.d + 1, o.op);
+        b->dimmable = dim_update(b->dimmable, 0, width, o.b, o.d + 1, o.op);
+        s->totals.on += band_on(b);
+        s->totals.brightness += band_brightness(b);
+    }
+}
+
+void print_running_totals(int count, light_totals totals) {
+    printf("after %d, lights on %ld, total brightness %ld\n", count, totals.on, totals.brightness);
+}
+
+// Only the last of the running totals, for comparing with the other engines.
+// The trees are the storage, so the one picked with -b and -d isn't used.
+bool run_stream(operation *ops, int count, light_storage lights, light_totals *totals) {
+    stream s;
+
+    (void)lights;
+    stream_init(&s);
+    for (int i = 0; i < count; i++)
+        stream_apply(&s, ops[i]);
+    *totals = s.totals;
+    stream_free(&s);
+    return true;
+}
+
+typedef bool (*engine_func)(operation *ops, int count, light_storage lights, light_totals *totals);
+
+typedef struct {
+    const char *name;
+    engine_func run;
+    bool uses_storage;      // or it has its own, and -b and -d don't matter
+} engine;
+
+const engine engines[] = {
+    { "dense", run_dense, true },
+    { "compressed", run_compressed, true },
+    { "tiled", run_tiled, false },
+    { "stream", run_stream, false },
+};
+
+#define ENGINE_COUNT    (int)(sizeof(engines) / sizeof(engine))
+
+const engine *select_engine(const char *name) {
+    for (int i = 0; i < ENGINE_COUNT; i++) {
+        if (strcmp(engines[i].name, name) == 0)
+            return engines + i;
+    }
+    fprintf(stderr, "error: unknown engine '%s'.\n", name);
+    return NULL;
+}
+
+// clock() is cpu time summed across all threads, so use wall time instead
+double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// every engine with every pairing of storages, on the same instructions
+bool run_benchmark(operation *ops, int count) {
+    printf("%d instructions on a %dx%d grid, %d threads\n", count, width, height, MAX(1, MIN(thread_count, MAX_THREADS)));
+    printf("%-12s %-6s %-6s %10s %16s %14s %12s %14s\n",
+        "engine", "part1", "part2", "seconds", "bytes touched", "peak bytes", "on", "brightness");
+
+    for (int e = 0; e < ENGINE_COUNT; e++) {
+        int binary_count = engines[e].uses_storage ? BINARY_STORAGE_COUNT : 1;
+        int dimmable_count = engines[e].uses_storage ? DIMMABLE_STORAGE_COUNT : 1;
+
+        for (int b = 0; b < binary_count; b++) {
+            for (int d = 0; d < dimmable_count; d++) {
+                light_storage lights = { binary_storages + b, dimmable_storages + d };
+                light_totals totals;
+
+                bytes_touched = 0;
+                peak_grid_bytes = grid_bytes = 0;
+
+                double start = wall_seconds();
+                bool ok = engines[e].run(ops, count, lights, &totals);
+                double elapsed = wall_seconds() - start;
+
+                printf("%-12s %-6s %-6s ", engines[e].name,
+                    engines[e].uses_storage ? lights.binary->name : "-",
+                    engines[e].uses_storage ? lights.dimmable->name : "-");
+                if (ok) {
+                    printf("%10.4f %16ld %14zu %12ld %14ld\n",
+                        elapsed, bytes_touched, peak_grid_bytes, totals.on, totals.brightness);
+                }
+                else
+                    printf("%10s\n", "failed");
+            }
+        }
+    }
+    return true;
+}
+
+// anything that doesn't fit on the grid is left out, with a complaint
+bool valid_operation(operation o) {
+    if (o.op == op_INVALID)
+        return false;
+    if (o.a < 0 || o.b < 0 || o.a > o.c || o.b > o.d || o.c >= height || o.d >= width) {
+        fprintf(stderr, "error: %d,%d through %d,%d doesn't fit a %dx%d grid.\n",
+            o.a, o.b, o.c, o.d, width, height);
+        return false;
+    }
+    return true;
+}
+
+// WIDTHxHEIGHT, both of them at least 1, with room to round up to whole words
+// and tiles without an int overflowing
+#define MAX_GRID_SIDE   (INT_MAX / 2)
+
+bool parse_grid_size(const char *size) {
+    char *end;
+    long w = strtol(size, &end, 10), h = 0;
+
+    if (*end == 'x' && isdigit(end[1]))
+        h = strtol(end + 1, &end, 10);
+    if (*end || w < 1 || h < 1 || w > MAX_GRID_SIDE || h > MAX_GRID_SIDE) {
+        fprintf(stderr, "error: the grid size '%s' isn't WIDTHxHEIGHT, with both from 1 to %d.\n", size, MAX_GRID_SIDE);
+        return false;
+    }
+
+    width = w;
+    height = h;
+    return true;
+}
+
+int main(int argc, char **argv) {
     FILE *input = stdin;
     char arg[128];
+    char *engine_name = "dense", *binary_name = "bits", *dimmable_name = "u16";
+    bool benchmark = false;
+
+    thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    operation *ops = NULL;
+    int op_count = 0, op_capacity = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            engine_name = argv[++i];
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            binary_name = argv[++i];
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            dimmable_name = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            thread_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-B") == 0)
+            benchmark = true;
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if (!parse_grid_size(argv[++i]))
+                return 1;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-m dense|compressed|tiled|stream] [-b bits|bytes] [-d u8|u16|u32|u64] [-t threads] [-B] [-s WIDTHxHEIGHT] < input\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const engine *run = select_engine(engine_name);
+    light_storage lights = {
+        select_storage(binary_storages, BINARY_STORAGE_COUNT, binary_name),
+        select_storage(dimmable_storages, DIMMABLE_STORAGE_COUNT, dimmable_name),
+    };
+    if (!run || !lights.binary || !lights.dimmable)
+        return 1;
+
+    // streaming doesn't wait for the rest of the instructions
+    bool streaming = run->run == run_stream && !benchmark;
+    stream s;
+
+    if (streaming) {
+        printf("using the %s engine\n", run->name);
+        stream_init(&s);
+    }
 
     while (fgets(arg, sizeof(arg) - 1, input)) {
         trim(arg);
         operation o = parse_operation(arg);
-        apply_operation(o, binary, dimmable);
+        if (!valid_operation(o))
+            continue;
+
+        if (streaming) {
+            stream_apply(&s, o);
+            print_running_totals(++op_count, s.totals);
+            fflush(stdout);
+            continue;
+        }
+
+        if (op_count == op_capacity) {
+            op_capacity = op_capacity ? op_capacity * 2 : 512;
+            ops = realloc(ops, op_capacity * sizeof(operation));
+            if (!ops) {
+                fprintf(stderr, "error: cannot allocate memory for %d operations.\n", op_capacity);
+                return 1;
+            }
+        }
+        ops[op_count++] = o;
+    }
+
+    if (streaming) {
+        printf("Part 1, lights remaining on %ld\n", s.totals.on);
+        printf("Part 2, total brightness %ld\n", s.totals.brightness);
+        stream_free(&s);
+        return 0;
+    }
+
+    // the most any one light could get is every on and toggle landing on it
+    unsigned long brightest = 0;
+    for (int i = 0; i < op_count; i++)
+        brightest += ops[i].op == op_ON ? 1 : ops[i].op == op_TOGGLE ? 2 : 0;
+    for (int i = 0; i < DIMMABLE_STORAGE_COUNT; i++) {
+        const storage *s = dimmable_storages + i;
+        if (brightest > s->max && (benchmark || s == lights.dimmable))
+            fprintf(stderr, "warning: %s lights stop at %lu, part 2 may come up short.\n", s->name, s->max);
     }
 
-    printf("using lights of type '%s'\n", light_type_name);
-    printf("Part 1, lights remaining on %d\n", count_lights_on(binary));
-    printf("Part 2, total brightness %d\n", count_lights_brightness(dimmable));
+    if (benchmark) {
+        bool ok = run_benchmark(ops, op_count);
+        free(ops);
+        return ok ? 0 : 1;
+    }
+
+    light_totals totals;
+
+    if (run->uses_storage)
+        printf("using the %s engine with %s and %s lights\n", run->name, lights.binary->name, lights.dimmable->name);
+    else
+        printf("using the %s engine\n", run->name);
+    if (!run->run(ops, op_count, lights, &totals))
+        return 1;
+
+    printf("Part 1, lights remaining on %ld\n", totals.on);
+    printf("Part 2, total brightness %ld\n", totals.brightness);
 
-    free(binary);
-    free(dimmable);
+    free(ops);
 
     return 0;
 }
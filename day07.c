@@ -51,12 +51,72 @@
 //
 // Part 2 was simply resetting the instructions to not be cached, and replacing
 // the expression for symbol 'b' with the value from part 1, then re-running.
+//
+// Update: re-parsing every expression with strstr and sscanf on every visit is
+// most of the work, and a deep enough circuit runs out of stack. So now the
+// instructions get compiled once at load time into gates, each an opcode and
+// the indexes of the wires it reads, and sorted so that every gate comes after
+// the ones that drive its inputs. Then it's a single flat loop over the gates,
+// no recursion, no parsing. '-m recursive' still runs the old way to compare.
+//
+// Update: the symbol lookup was a linear search that rehashed the name on every
+// step, and the hash only really worked up to 3 letters before two names could
+// collide. Now it's a real hash table, open addressing over the instruction
+// indexes, so a name is one hash and (almost always) one strcmp away, however
+// long it is, up to MAX_SYMBOL_CHARS. Anything longer is turned away when it's
+// read, so every sscanf of a name can be bounded by that and never truncate.
+// The instruction's index is the wire's id everywhere else.
+//
+// Update: part 2 only changes b, but it was re-running the whole circuit. Now
+// overriding wires just re-evaluates what's downstream of them, in order, and
+// stops following any gate whose value didn't actually change. Restoring them
+// afterwards works the same way. '-w count' runs that many random what-ifs,
+// override one wire, read a, put it back, to see what it costs.
+//
+// Update: for running the same circuit over lots of different inputs, there's
+// a batch mode that runs 64, 256 or 512 of them in one pass. It's bit-sliced:
+// each wire is 16 words, one per bit of the signal, and bit l of every word
+// belongs to lane l. AND, OR and NOT are then just the same op on each word,
+// for every lane at once, and a shift doesn't even compute anything, it just
+// moves words around. The words are wider vectors for more lanes, compiled for
+// avx2 and avx512 where the cpu has them, same as the MD5 engines in day04.
+// '-v count' runs that many values of 'b' through it, '-e' picks the engine.
+// A batch only runs the cone of gates that 'a' actually reads from, and dead
+// wires give their slot to the next one, otherwise the planes are megabytes
+// and wider lanes just mean more cache misses. Measured on one core: 60k gates
+// where 'a' needs 516 of them (117 slots) do 5.9M values/sec at 64 lanes,
+// 23.5M at 256 and 26.4M at 512. 1M gates where it needs 491k (15k slots, 15mb
+// of planes at 512) do 3.4k, 8.2k and 9.2k. So the gain past 256 is small, and
+// it's the size of the cone, not the lanes, that sets the rate.
+//
+// Update: bigger circuits. The instructions and the symbol table grow as
+// needed instead of topping out at 500, and a full run can be split across
+// threads ('-t'). The gates come out of the sort in levels, where each level
+// only reads from the ones before it, so a level's gates can all run at once
+// with just a barrier before the next. Each thread takes chunks of its own
+// share of a level, then steals chunks from everyone else's once it runs out.
+// '-r count' times that many full runs and reports gates/sec.
+//
+// Update: for a circuit that gets run millions of times, even the bytecode
+// loop is overhead. So it can write itself out as C, one straight-line
+// function with a local per wire in gate order, have 'cc' compile that into a
+// shared library, and dlopen it. The override wires are the function's inputs
+// and 'a' is its output, and the compiler throws away anything 'a' doesn't
+// need. '-n count' runs that many values of 'b' through it, and through the
+// original recursive evaluator, to compare. $CC picks another compiler.
 
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <pthread.h>
+#include <dlfcn.h>
 
 char *trim(char *str) {
     char *p = str + (strlen(str) - 1);
@@ -66,10 +126,17 @@ char *trim(char *str) {
     return str;
 }
 
-int eval_count = 0;
+// clock() is cpu time summed across all threads, so use wall time instead
+double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+long eval_count = 0;
 
 typedef unsigned short signal_t;
-typedef unsigned short hash_t;
+typedef unsigned hash_t;
 
 typedef struct {
     hash_t id;
@@ -79,32 +146,51 @@ typedef struct {
     signal_t value;
 } instruction;
 
-// there are 339 in the input data, so...
-#define MAX_SYMBOL_LENGTH   20
-#define MAX_INSTRUCTIONS    500
+// there are 339 in the input data, but the instructions grow as needed
+#define MAX_SYMBOL_CHARS    63
+#define MAX_SYMBOL_LENGTH   (MAX_SYMBOL_CHARS + 1)
+
+#define STRINGIFY_(x)       #x
+#define STRINGIFY(x)        STRINGIFY_(x)
+#define SYMBOL_SCAN         "%" STRINGIFY(MAX_SYMBOL_CHARS) "s"
 int instruction_count = 0;
-instruction instructions[MAX_INSTRUCTIONS];
+int instruction_capacity = 0;
+instruction *instructions = NULL;
+
+// symbol_slots is an open addressed hash table of the symbols, each slot the
+// index + 1 of an instruction (0 is empty). It's kept at most half full, and
+// doubles and gets refilled when it would be more.
+int symbol_slot_count = 0;
+int *symbol_slots = NULL;
 
-// doing a dumb transliteration hash, that allows for up to 3 characters in a
-// symbol name. it's not interesting except that it makes linear searching faster.
+// FNV-1a, the full 32 bits get kept in the instruction so most mismatches
+// don't even need a strcmp
 hash_t hash_symbol(char *sym) {
-    int hash = 0;
+    hash_t hash = 2166136261u;
     while (*sym) {
-        hash = (hash << 5) + (*sym - 'a' + 1);
+        hash = (hash ^ (unsigned char)*sym) * 16777619u;
         sym++;
     }
     return hash;
 }
 
-instruction *find_instruction_for_symbol(char *sym) {
-    for (int i = 0; i < instruction_count; i++) {
-        // if (strcmp(sym, instructions[i].sym) == 0) {
-        if (hash_symbol(sym) == instructions[i].id) {
-            return &instructions[i];
-        }
+// the slot a symbol is in, or the empty one it would go in
+int find_symbol_slot(char *sym, hash_t hash) {
+    int slot = hash & (symbol_slot_count - 1);
+    while (symbol_slots[slot]) {
+        instruction *instr = &instructions[symbol_slots[slot] - 1];
+        if (instr->id == hash && strcmp(sym, instr->sym) == 0)
+            break;
+        slot = (slot + 1) & (symbol_slot_count - 1);
     }
+    return slot;
+}
 
-    return NULL;
+instruction *find_instruction_for_symbol(char *sym) {
+    if (symbol_slot_count == 0)
+        return NULL;
+    int index = symbol_slots[find_symbol_slot(sym, hash_symbol(sym))];
+    return index ? &instructions[index - 1] : NULL;
 }
 
 // need a forward declaration, not only for circular dependency but intermixed
@@ -122,36 +208,36 @@ signal_t evaluate_expression(char *exp) {
 
         // gotta handle a symbol or constant on lhs
         if (isalpha(*exp)) {
-            sscanf(exp, "%s AND %s", lhsym, rhsym);
+            sscanf(exp, SYMBOL_SCAN " AND " SYMBOL_SCAN, lhsym, rhsym);
             result = evaluate_symbol_value(lhsym) & evaluate_symbol_value(rhsym);
         }
         else {
-            sscanf(exp, "%d AND %s", &lhconst, rhsym);
+            sscanf(exp, "%d AND " SYMBOL_SCAN, &lhconst, rhsym);
             result = lhconst & evaluate_symbol_value(rhsym);
         }
     }
     else if (strstr(exp, " OR ")) {
         char lhsym[MAX_SYMBOL_LENGTH], rhsym[MAX_SYMBOL_LENGTH];
-        sscanf(exp, "%s OR %s", lhsym, rhsym);
+        sscanf(exp, SYMBOL_SCAN " OR " SYMBOL_SCAN, lhsym, rhsym);
         result = evaluate_symbol_value(lhsym) | evaluate_symbol_value(rhsym);
     }
     // Search for the binary SHIFT operators, 'sym xSHIFT const'
     else if (strstr(exp, " LSHIFT ")) {
         char lhsym[MAX_SYMBOL_LENGTH];
         int val;
-        sscanf(exp, "%s LSHIFT %d", lhsym, &val);
+        sscanf(exp, SYMBOL_SCAN " LSHIFT %d", lhsym, &val);
         result = evaluate_symbol_value(lhsym) << val;
     }
     else if (strstr(exp, " RSHIFT ")) {
         char lhsym[MAX_SYMBOL_LENGTH];
         int val;
-        sscanf(exp, "%s RSHIFT %d", lhsym, &val);
+        sscanf(exp, SYMBOL_SCAN " RSHIFT %d", lhsym, &val);
         result = evaluate_symbol_value(lhsym) >> val;
     }
     // Search for the unary NOT operator, 'NOT sym'
     else if (strstr(exp, "NOT ")) {
         char rhsym[MAX_SYMBOL_LENGTH];
-        sscanf(exp, "NOT %s", rhsym);
+        sscanf(exp, "NOT " SYMBOL_SCAN, rhsym);
         result = ~evaluate_symbol_value(rhsym);
     }
     // Assume what's left is an immediate, so determine if its sym or const
@@ -228,9 +314,67 @@ char *crack_expression(char *instruction) {
     return NULL;
 }
 
+bool grow_instructions(void) {
+    if (instruction_count == instruction_capacity) {
+        int capacity = instruction_capacity ? instruction_capacity * 2 : 512;
+        instruction *grown = realloc(instructions, capacity * sizeof(instruction));
+        if (!grown) {
+            fprintf(stderr, "error: cannot allocate memory for %d instructions.\n", capacity);
+            return false;
+        }
+        instructions = grown;
+        instruction_capacity = capacity;
+    }
+
+    if ((instruction_count + 1) * 2 > symbol_slot_count) {
+        int slot_count = symbol_slot_count ? symbol_slot_count * 2 : 1024;
+        int *slots = calloc(slot_count, sizeof(int));
+        if (!slots) {
+            fprintf(stderr, "error: cannot allocate memory for %d symbols.\n", slot_count);
+            return false;
+        }
+        free(symbol_slots);
+        symbol_slots = slots;
+        symbol_slot_count = slot_count;
+        for (int i = 0; i < instruction_count; i++)
+            symbol_slots[find_symbol_slot(instructions[i].sym, instructions[i].id)] = i + 1;
+    }
+
+    return true;
+}
+
+// every word of it, names and operators both, fits in MAX_SYMBOL_LENGTH
+bool names_fit(const char *text) {
+    const char *p = text;
+
+    while (*p) {
+        size_t len = strcspn(p, " ");
+        if (len > MAX_SYMBOL_CHARS)
+            return false;
+        p += len;
+        p += strspn(p, " ");
+    }
+    return true;
+}
+
 void add_instruction(char *sym, char *exp) {
     instruction instr;
+
+    if (!names_fit(sym) || !names_fit(exp)) {
+        fprintf(stderr, "error: a name in '%s -> %s' is longer than %d characters.\n", exp, sym, MAX_SYMBOL_CHARS);
+        return;
+    }
+    if (!grow_instructions())
+        return;
+
     instr.id = hash_symbol(sym);
+    int slot = find_symbol_slot(sym, instr.id);
+    if (symbol_slots[slot]) {
+        fprintf(stderr, "error: symbol '%s' is driven by more than one instruction.\n", sym);
+        return;
+    }
+    symbol_slots[slot] = instruction_count + 1;
+
     instr.sym = strdup(sym);
     instr.exp = strdup(exp);
     instr.evaluated = false;
@@ -238,40 +382,1116 @@ void add_instruction(char *sym, char *exp) {
     instructions[instruction_count++] = instr;
 }
 
+// The bytecode. A wire's index is the index of the instruction that drives it,
+// and each constant operand gets a wire of its own after those, driven by an
+// op_CONST gate. So every wire has exactly one gate.
+typedef enum {
+    op_CONST,       // value = a, an immediate
+    op_SET,         // value = wire a
+    op_AND,
+    op_OR,
+    op_LSHIFT,      // wire a shifted by b, an immediate
+    op_RSHIFT,
+    op_NOT,
+} opcode;
+
+typedef struct {
+    opcode op;
+    int dest;
+    int a, b;
+} gate;
+
+typedef struct {
+    int gate_count;
+    gate *gates;            // in topological order, once compiled
+    gate *compiled;         // the gates before any overrides
+    int wire_count;
+    signal_t *values;
+    int *position;          // of each wire's gate in gates
+    int *first_reader;      // readers[first_reader[w] ... first_reader[w + 1]]
+    int *readers;           // are the positions of the gates reading wire w
+    int *queued;            // the pass that each gate was last queued in
+    int pass;
+    int *heap;              // the queued positions, lowest first
+    int level_count;        // gates level_start[l] ... level_start[l + 1] only
+    int *level_start;       // read gates from earlier levels
+} program;
+
+int wire_for_symbol(char *sym) {
+    instruction *instr = find_instruction_for_symbol(sym);
+    if (!instr) {
+        fprintf(stderr, "error: cannot find symbol '%s' in the instruction table.\n", sym);
+        return -1;
+    }
+    return instr - instructions;
+}
+
+// a symbol is its instruction's wire, a constant gets a new wire and gate
+int compile_operand(program *p, char *operand) {
+    if (isdigit(*operand)) {
+        gate g = { op_CONST, p->wire_count++, atoi(operand), 0 };
+        p->gates[p->gate_count++] = g;
+        return g.dest;
+    }
+    return wire_for_symbol(operand);
+}
+
+bool compile_instruction(program *p, int wire, char *exp) {
+    char lhs[MAX_SYMBOL_LENGTH], rhs[MAX_SYMBOL_LENGTH];
+    int amount;
+    gate g = { op_SET, wire, 0, 0 };
+
+    if (sscanf(exp, "NOT " SYMBOL_SCAN, rhs) == 1) {
+        g.op = op_NOT;
+        g.a = compile_operand(p, rhs);
+    }
+    else if (sscanf(exp, SYMBOL_SCAN " AND " SYMBOL_SCAN, lhs, rhs) == 2 || sscanf(exp, SYMBOL_SCAN " OR " SYMBOL_SCAN, lhs, rhs) == 2) {
+        g.op = strstr(exp, " AND ") ? op_AND : op_OR;
+        g.a = compile_operand(p, lhs);
+        g.b = compile_operand(p, rhs);
+    }
+    else if (sscanf(exp, SYMBOL_SCAN " LSHIFT %d", lhs, &amount) == 2 || sscanf(exp, SYMBOL_SCAN " RSHIFT %d", lhs, &amount) == 2) {
+        g.op = strstr(exp, " LSHIFT ") ? op_LSHIFT : op_RSHIFT;
+        g.a = compile_operand(p, lhs);
+        g.b = amount;
+    }
+    else if (isdigit(*exp)) {
+        g.op = op_CONST;
+        g.a = atoi(exp);
+    }
+    else {
+        g.a = compile_operand(p, exp);
+    }
+
+    if (g.a < 0 || g.b < 0) {
+        fprintf(stderr, "error: cannot compile the expression for %s, %s\n", instructions[wire].sym, exp);
+        return false;
+    }
+
+    p->gates[p->gate_count++] = g;
+    return true;
+}
+
+// the wires a gate reads, which is what it has to wait on
+int gate_inputs(gate *g, int *inputs) {
+    switch (g->op) {
+        case op_CONST:
+            return 0;
+        case op_AND:
+        case op_OR:
+            inputs[0] = g->a;
+            inputs[1] = g->b;
+            return 2;
+        default:
+            inputs[0] = g->a;
+            return 1;
+    }
+}
+
+// Kahn's algorithm: start with the gates that read nothing, and each time a
+// gate is placed, anything that was only waiting on it can go next. If some
+// are never ready, the circuit has a loop. Taking them in waves, everything
+// made ready by one wave is the next, which groups the gates into levels.
+bool sort_gates(program *p) {
+    int n = p->gate_count;
+    int *waiting = malloc(n * sizeof(int));
+    int *first_reader = calloc(p->wire_count + 1, sizeof(int));
+    int *next_reader = malloc(p->wire_count * sizeof(int));
+    int *readers = malloc(2 * n * sizeof(int));
+    int *ready = malloc(n * sizeof(int));
+    gate *sorted = malloc(n * sizeof(gate));
+    int inputs[2];
+    int head = 0, tail = 0, level_end;
+
+    p->level_count = 0;
+    p->level_start = malloc((n + 1) * sizeof(int));
+    p->level_start[0] = 0;
+
+    // readers[first_reader[w] ... first_reader[w + 1]] are the gates reading w
+    for (int i = 0; i < n; i++) {
+        waiting[i] = gate_inputs(&p->gates[i], inputs);
+        for (int k = 0; k < waiting[i]; k++)
+            first_reader[inputs[k] + 1]++;
+        if (waiting[i] == 0)
+            ready[tail++] = i;
+    }
+    for (int w = 0; w < p->wire_count; w++) {
+        first_reader[w + 1] += first_reader[w];
+        next_reader[w] = first_reader[w];
+    }
+    for (int i = 0; i < n; i++) {
+        for (int k = gate_inputs(&p->gates[i], inputs) - 1; k >= 0; k--)
+            readers[next_reader[inputs[k]]++] = i;
+    }
+
+    level_end = tail;
+    while (head < tail) {
+        if (head == level_end) {
+            p->level_start[++p->level_count] = head;
+            level_end = tail;
+        }
+
+        int i = ready[head++];
+        int w = p->gates[i].dest;
+        sorted[head - 1] = p->gates[i];
+        for (int r = first_reader[w]; r < first_reader[w + 1]; r++) {
+            if (--waiting[readers[r]] == 0)
+                ready[tail++] = readers[r];
+        }
+    }
+
+    if (head > 0)
+        p->level_start[++p->level_count] = head;
+
+    bool ok = head == n;
+    if (ok)
+        memcpy(p->gates, sorted, n * sizeof(gate));
+    else
+        fprintf(stderr, "error: %d gates are in a loop and can never be evaluated.\n", n - head);
+
+    free(waiting);
+    free(first_reader);
+    free(next_reader);
+    free(readers);
+    free(ready);
+    free(sorted);
+    return ok;
+}
+
+// with the gates in order, who reads what, by position, for the incremental
+// updates. Overrides only ever take inputs away, so the compiled gates' readers
+// cover every gate that could need updating.
+bool index_gates(program *p) {
+    int n = p->gate_count;
+    int inputs[2];
+
+    p->compiled = malloc(n * sizeof(gate));
+    p->position = malloc(p->wire_count * sizeof(int));
+    p->first_reader = calloc(p->wire_count + 1, sizeof(int));
+    p->readers = malloc(2 * n * sizeof(int));
+    p->queued = calloc(n, sizeof(int));
+    p->heap = malloc(n * sizeof(int));
+    p->pass = 0;
+    if (!p->compiled || !p->position || !p->first_reader || !p->readers || !p->queued || !p->heap) {
+        fprintf(stderr, "error: cannot allocate memory for %d gates.\n", n);
+        return false;
+    }
+
+    memcpy(p->compiled, p->gates, n * sizeof(gate));
+    for (int i = 0; i < n; i++) {
+        p->position[p->gates[i].dest] = i;
+        for (int k = gate_inputs(&p->gates[i], inputs) - 1; k >= 0; k--)
+            p->first_reader[inputs[k]]++;
+    }
+
+    // running totals put first_reader[w] at the end of w's readers, then
+    // filling them in from the back walks it down to the start
+    for (int w = 1; w <= p->wire_count; w++)
+        p->first_reader[w] += p->first_reader[w - 1];
+    for (int i = n - 1; i >= 0; i--) {
+        for (int k = gate_inputs(&p->gates[i], inputs) - 1; k >= 0; k--)
+            p->readers[--p->first_reader[inputs[k]]] = i;
+    }
+
+    return true;
+}
+
+// at most two constants per instruction, so that's the most gates and wires
+bool compile_program(program *p) {
+    p->gate_count = 0;
+    p->wire_count = instruction_count;
+    p->gates = malloc(3 * instruction_count * sizeof(gate));
+    p->values = calloc(3 * instruction_count, sizeof(signal_t));
+
+    for (int i = 0; i < instruction_count; i++) {
+        if (!compile_instruction(p, i, instructions[i].exp))
+            return false;
+    }
+
+    return sort_gates(p) && index_gates(p);
+}
+
+void free_program(program *p) {
+    free(p->gates);
+    free(p->compiled);
+    free(p->values);
+    free(p->position);
+    free(p->first_reader);
+    free(p->readers);
+    free(p->queued);
+    free(p->heap);
+    free(p->level_start);
+}
+
+static inline signal_t evaluate_gate(gate *g, signal_t *v) {
+    switch (g->op) {
+        case op_CONST:  return g->a;
+        case op_SET:    return v[g->a];
+        case op_AND:    return v[g->a] & v[g->b];
+        case op_OR:     return v[g->a] | v[g->b];
+        case op_LSHIFT: return v[g->a] << g->b;
+        case op_RSHIFT: return v[g->a] >> g->b;
+        case op_NOT:    return ~v[g->a];
+    }
+    return 0;
+}
+
+void run_program(program *p) {
+    for (gate *g = p->gates; g < p->gates + p->gate_count; g++)
+        p->values[g->dest] = evaluate_gate(g, p->values);
+    eval_count += p->gate_count;
+}
+
+// Level-parallel full runs. Levels too small to be worth waking everyone up
+// for get run by the first thread alone, as many in a row as there are, so a
+// step is either one big level for everyone, or a run of small ones for one.
+#define MAX_THREADS         64
+#define LEVEL_CHUNK         1024
+#define MIN_PARALLEL_GATES  (4 * LEVEL_CHUNK)
+
+// pthread_barrier_t isn't on macOS, so here's one
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t all_here;
+    int count;
+    int waiting;
+    int generation;
+} level_barrier;
+
+void barrier_wait(level_barrier *b) {
+    pthread_mutex_lock(&b->lock);
+    int generation = b->generation;
+    if (++b->waiting == b->count) {
+        b->waiting = 0;
+        b->generation++;
+        pthread_cond_broadcast(&b->all_here);
+    }
+    else {
+        while (generation == b->generation)
+            pthread_cond_wait(&b->all_here, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+// a thread's share of a step, gates next ... end, padded out to its own cache
+// line since everyone hammers on next once they start stealing
+typedef struct {
+    atomic_int next;
+    int end;
+    char padding[64 - sizeof(atomic_int) - sizeof(int)];
+} level_share;
+
+typedef struct {
+    program *p;
+    int thread_count;
+    int step_count;
+    int *step_start;        // gates step_start[s] ... step_start[s + 1]
+    bool *step_parallel;
+    // by step parity, so setting up the next step's shares can't get mixed up
+    // with someone still stealing from this one's
+    level_share shares[2][MAX_THREADS];
+    level_barrier barrier;
+} level_run;
+
+typedef struct {
+    level_run *run;
+    int id;
+} level_worker_arg;
+
+void plan_steps(level_run *r) {
+    program *p = r->p;
+
+    r->step_count = 0;
+    r->step_start[0] = 0;
+    for (int l = 0; l < p->level_count; ) {
+        bool parallel = p->level_start[l + 1] - p->level_start[l] >= MIN_PARALLEL_GATES;
+        l++;
+        while (!parallel && l < p->level_count && p->level_start[l + 1] - p->level_start[l] < MIN_PARALLEL_GATES)
+            l++;
+        r->step_parallel[r->step_count] = parallel;
+        r->step_start[++r->step_count] = p->level_start[l];
+    }
+}
+
+void set_share(level_run *r, int step, int id) {
+    if (step >= r->step_count || !r->step_parallel[step])
+        return;
+
+    int start = r->step_start[step], size = r->step_start[step + 1] - start;
+    level_share *share = &r->shares[step % 2][id];
+    atomic_store(&share->next, start + (int)((long)size * id / r->thread_count));
+    share->end = start + (int)((long)size * (id + 1) / r->thread_count);
+}
+
+void run_share(program *p, level_share *share) {
+    for (;;) {
+        int i = atomic_fetch_add(&share->next, LEVEL_CHUNK);
+        if (i >= share->end)
+            return;
+        for (int end = MIN(i + LEVEL_CHUNK, share->end); i < end; i++)
+            p->values[p->gates[i].dest] = evaluate_gate(&p->gates[i], p->values);
+    }
+}
+
+void *level_worker(void *arg) {
+    level_run *r = ((level_worker_arg *)arg)->run;
+    int id = ((level_worker_arg *)arg)->id;
+    program *p = r->p;
+
+    for (int s = 0; s < r->step_count; s++) {
+        if (r->step_parallel[s]) {
+            // mine first, then everyone else's
+            for (int k = 0; k < r->thread_count; k++)
+                run_share(p, &r->shares[s % 2][(id + k) % r->thread_count]);
+        }
+        else if (id == 0) {
+            for (int i = r->step_start[s]; i < r->step_start[s + 1]; i++)
+                p->values[p->gates[i].dest] = evaluate_gate(&p->gates[i], p->values);
+        }
+
+        set_share(r, s + 1, id);
+        barrier_wait(&r->barrier);
+    }
+
+    return NULL;
+}
+
+void run_program_threaded(program *p, int thread_count) {
+    pthread_t threads[MAX_THREADS];
+    level_worker_arg args[MAX_THREADS];
+    level_run r;
+
+    thread_count = MAX(1, MIN(thread_count, MAX_THREADS));
+    if (thread_count == 1) {
+        run_program(p);
+        return;
+    }
+
+    r.p = p;
+    r.thread_count = thread_count;
+    r.step_start = malloc((p->level_count + 1) * sizeof(int));
+    r.step_parallel = malloc(MAX(p->level_count, 1) * sizeof(bool));
+    plan_steps(&r);
+
+    pthread_mutex_init(&r.barrier.lock, NULL);
+    pthread_cond_init(&r.barrier.all_here, NULL);
+    r.barrier.count = thread_count;
+    r.barrier.waiting = 0;
+    r.barrier.generation = 0;
+
+    for (int t = 0; t < thread_count; t++) {
+        set_share(&r, 0, t);
+        args[t].run = &r;
+        args[t].id = t;
+    }
+    for (int t = 1; t < thread_count; t++)
+        pthread_create(&threads[t], NULL, level_worker, &args[t]);
+    level_worker(&args[0]);
+    for (int t = 1; t < thread_count; t++)
+        pthread_join(threads[t], NULL);
+    eval_count += p->gate_count;
+
+    pthread_mutex_destroy(&r.barrier.lock);
+    pthread_cond_destroy(&r.barrier.all_here);
+    free(r.step_start);
+    free(r.step_parallel);
+}
+
+// a binary heap of gate positions, so the queued gates come out in order
+void heap_push(program *p, int *size, int position) {
+    int i = (*size)++;
+    while (i > 0 && p->heap[(i - 1) / 2] > position) {
+        p->heap[i] = p->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    p->heap[i] = position;
+}
+
+int heap_pop(program *p, int *size) {
+    int top = p->heap[0];
+    int last = p->heap[--(*size)];
+    int i = 0;
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *size)
+            break;
+        if (child + 1 < *size && p->heap[child + 1] < p->heap[child])
+            child++;
+        if (p->heap[child] >= last)
+            break;
+        p->heap[i] = p->heap[child];
+        i = child;
+    }
+    p->heap[i] = last;
+    return top;
+}
+
+// Re-evaluates the gates driving these wires and whatever is downstream of
+// them. A gate is only ever popped after everything it reads has settled,
+// since those all come earlier in the order, and its readers only get queued
+// if its value actually changed. So it's just the part of the fan-out cone
+// that really moves, each gate at most once.
+void update_wires(program *p, int count, int *wires) {
+    int size = 0;
+
+    p->pass++;
+    for (int k = 0; k < count; k++) {
+        int position = p->position[wires[k]];
+        if (p->queued[position] != p->pass) {
+            p->queued[position] = p->pass;
+            heap_push(p, &size, position);
+        }
+    }
+
+    while (size > 0) {
+        gate *g = &p->gates[heap_pop(p, &size)];
+        signal_t value = evaluate_gate(g, p->values);
+        eval_count++;
+        if (value == p->values[g->dest])
+            continue;
+
+        p->values[g->dest] = value;
+        for (int r = p->first_reader[g->dest]; r < p->first_reader[g->dest + 1]; r++) {
+            int reader = p->readers[r];
+            if (p->queued[reader] != p->pass) {
+                p->queued[reader] = p->pass;
+                heap_push(p, &size, reader);
+            }
+        }
+    }
+}
+
+// the gate driving a wire just becomes a constant, which can stay where it is
+// in the order since it doesn't read anything
+void override_wires(program *p, int count, int *wires, signal_t *values) {
+    for (int k = 0; k < count; k++) {
+        gate g = { op_CONST, wires[k], values[k], 0 };
+        p->gates[p->position[wires[k]]] = g;
+    }
+    update_wires(p, count, wires);
+}
+
+// makes the overrides on these wires stick, so restore_wires puts them back
+// to what they are now rather than what was compiled
+void keep_overrides(program *p, int count, int *wires) {
+    for (int k = 0; k < count; k++)
+        p->compiled[p->position[wires[k]]] = p->gates[p->position[wires[k]]];
+}
+
+void restore_wires(program *p, int count, int *wires) {
+    for (int k = 0; k < count; k++)
+        p->gates[p->position[wires[k]]] = p->compiled[p->position[wires[k]]];
+    update_wires(p, count, wires);
+}
+
+// Batches. planes has 16 words per slot, word k holding bit k of the signal,
+// one bit per lane. As plain 64 bit words, lane l of plane k of slot s is bit
+// l % 64 of word (s * 16 + k) * lanes / 64 + l / 64, which is also where it
+// lands in a vector of them, so packing and unpacking don't care which engine.
+// A batch only runs the gates the target actually reads from, and a wire only
+// holds a slot from its gate to its last reader, so the planes are as small as
+// they can be.
+typedef void (*batch_fn)(const gate *gates, int gate_count, void *planes);
+
+typedef struct {
+    const char *name;
+    int lanes;
+    batch_fn run;
+} batch_engine;
+
+#define DEFINE_BATCH_ENGINE(name, V, attr)                                      \
+attr void name(const gate *gates, int gate_count, void *planes) {               \
+    V (*w)[16] = planes;                                                        \
+    V zero = (V){0}, ones = zero - 1;                                           \
+    for (const gate *g = gates; g < gates + gate_count; g++) {                  \
+        V *out = w[g->dest];                                                    \
+        switch (g->op) {                                                        \
+            case op_CONST:                                                      \
+                for (int k = 0; k < 16; k++)                                    \
+                    out[k] = (g->a >> k) & 1 ? ones : zero;                     \
+                break;                                                          \
+            case op_SET:                                                        \
+                memcpy(out, w[g->a], sizeof(w[0]));                             \
+                break;                                                          \
+            case op_AND:                                                        \
+                for (int k = 0; k < 16; k++)                                    \
+                    out[k] = w[g->a][k] & w[g->b][k];                           \
+                break;                                                          \
+            case op_OR:                                                         \
+                for (int k = 0; k < 16; k++)                                    \
+                    out[k] = w[g->a][k] | w[g->b][k];                           \
+                break;                                                          \
+            case op_LSHIFT:                                                     \
+                for (int k = 0; k < 16; k++)                                    \
+                    out[k] = k >= g->b ? w[g->a][k - g->b] : zero;              \
+                break;                                                          \
+            case op_RSHIFT:                                                     \
+                for (int k = 0; k < 16; k++)                                    \
+                    out[k] = k + g->b < 16 ? w[g->a][k + g->b] : zero;          \
+                break;                                                          \
+            case op_NOT:                                                        \
+                for (int k = 0; k < 16; k++)                                    \
+                    out[k] = ~w[g->a][k];                                       \
+                break;                                                          \
+        }                                                                       \
+    }                                                                           \
+}
+
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+typedef uint64_t u64x8 __attribute__((vector_size(64)));
+
+DEFINE_BATCH_ENGINE(batch_64, uint64_t, )
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_LANES
+DEFINE_BATCH_ENGINE(batch_256_avx2, u64x4, __attribute__((target("avx2"))))
+DEFINE_BATCH_ENGINE(batch_512_avx512, u64x8, __attribute__((target("avx512f"))))
+#else
+DEFINE_BATCH_ENGINE(batch_256, u64x4, )
+DEFINE_BATCH_ENGINE(batch_512, u64x8, )
+#endif
+
+batch_engine batch_engines[] = {
+#ifdef HAVE_X86_LANES
+    { "avx512", 512, batch_512_avx512 },
+    { "avx2",   256, batch_256_avx2 },
+#else
+    { "512",    512, batch_512 },
+    { "256",    256, batch_256 },
+#endif
+    { "64",      64, batch_64 },
+};
+#define BATCH_ENGINE_COUNT  (int)(sizeof(batch_engines) / sizeof(batch_engines[0]))
+
+bool batch_engine_supported(const batch_engine *e) {
+#ifdef HAVE_X86_LANES
+    __builtin_cpu_init();
+    if (strcmp(e->name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    if (strcmp(e->name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return true;
+}
+
+// with no name, picks the widest engine the cpu supports
+const batch_engine *select_batch_engine(const char *name) {
+    for (int i = 0; i < BATCH_ENGINE_COUNT; i++) {
+        const batch_engine *e = &batch_engines[i];
+        if (name && strcmp(name, e->name) != 0)
+            continue;
+        if (batch_engine_supported(e))
+            return e;
+        fprintf(stderr, "error: the cpu does not support the '%s' batch engine.\n", e->name);
+        return NULL;
+    }
+
+    fprintf(stderr, "error: there is no batch engine named '%s'.\n", name);
+    return NULL;
+}
+
+// The gates that feed the target, in order, with their wires renumbered to
+// slots. The inputs get slots up front, since they're packed before it runs.
+typedef struct {
+    int gate_count;
+    gate *gates;
+    int slot_count;
+    int input_count;
+    int *input_slots;       // -1 for an input the target doesn't read
+    int target_slot;
+} batch_plan;
+
+void free_batch_plan(batch_plan *plan) {
+    free(plan->gates);
+    free(plan->input_slots);
+}
+
+// Any overrides already in place are baked into the plan, and hold for every
+// lane. Slots are handed out from a stack of free ones, and a gate's dest is
+// given its slot before the slots of its inputs are let go, since a shift
+// can't write over what it's still reading.
+bool plan_batch(program *p, int count, int *wires, int target, batch_plan *plan) {
+    bool *needed = calloc(p->wire_count, sizeof(bool));
+    bool *is_input = calloc(p->wire_count, sizeof(bool));
+    int *last_use = malloc(p->wire_count * sizeof(int));
+    int *slot_of = malloc(p->wire_count * sizeof(int));
+    int *free_slots = malloc(p->wire_count * sizeof(int));
+    int free_count = 0;
+    int inputs[2];
+
+    plan->gates = malloc(p->gate_count * sizeof(gate));
+    plan->input_slots = malloc(count * sizeof(int));
+    if (!needed || !is_input || !last_use || !slot_of || !free_slots || !plan->gates || !plan->input_slots) {
+        fprintf(stderr, "error: cannot allocate memory for a batch plan of %d gates.\n", p->gate_count);
+        free(needed);
+        free(is_input);
+        free(last_use);
+        free(slot_of);
+        free(free_slots);
+        free_batch_plan(plan);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++)
+        is_input[wires[i]] = true;
+
+    // the cone: everything the target reads, back as far as the inputs
+    needed[target] = true;
+    for (int i = p->gate_count - 1; i >= 0; i--) {
+        gate *g = &p->gates[i];
+        if (!needed[g->dest] || is_input[g->dest])
+            continue;
+        for (int k = gate_inputs(g, inputs) - 1; k >= 0; k--)
+            needed[inputs[k]] = true;
+    }
+
+    plan->gate_count = 0;
+    for (int i = 0; i < p->gate_count; i++) {
+        gate *g = &p->gates[i];
+        if (!needed[g->dest] || is_input[g->dest])
+            continue;
+        for (int k = gate_inputs(g, inputs) - 1; k >= 0; k--)
+            last_use[inputs[k]] = plan->gate_count;
+        plan->gates[plan->gate_count++] = *g;
+    }
+    last_use[target] = INT_MAX;
+
+    plan->slot_count = 0;
+    plan->input_count = count;
+    for (int i = 0; i < count; i++) {
+        plan->input_slots[i] = -1;
+        if (needed[wires[i]]) {
+            slot_of[wires[i]] = plan->slot_count++;
+            plan->input_slots[i] = slot_of[wires[i]];
+            needed[wires[i]] = false;   // so a repeat doesn't get a second slot
+        }
+    }
+
+    for (int n = 0; n < plan->gate_count; n++) {
+        gate *g = &plan->gates[n];
+        int reads = gate_inputs(g, inputs);
+
+        g->dest = slot_of[g->dest] = free_count ? free_slots[--free_count] : plan->slot_count++;
+        if (reads > 0)
+            g->a = slot_of[inputs[0]];
+        if (reads > 1)
+            g->b = slot_of[inputs[1]];
+        for (int k = 0; k < reads; k++) {
+            if (last_use[inputs[k]] == n && (k == 0 || inputs[1] != inputs[0]))
+                free_slots[free_count++] = slot_of[inputs[k]];
+        }
+    }
+    plan->target_slot = slot_of[target];
+
+    free(needed);
+    free(is_input);
+    free(last_use);
+    free(slot_of);
+    free(free_slots);
+    return true;
+}
+
+void *alloc_planes(batch_plan *plan, const batch_engine *e) {
+    size_t size = (size_t)MAX(plan->slot_count, 1) * 16 * e->lanes / 8;
+    void *planes = aligned_alloc(64, (size + 63) & ~(size_t)63);
+    if (!planes)
+        fprintf(stderr, "error: cannot allocate memory for a batch of %d.\n", e->lanes);
+    return planes;
+}
+
+// Going between lanes and planes is a bit matrix transpose, 16 lanes of 16
+// bits at a time. This is the one from Hacker's Delight, swapping 8x8 blocks,
+// then 4x4 inside those, and so on. It counts bits from the top, so the lanes
+// go in backwards, and then row 15 - k comes out as plane k, lane l in bit l.
+// It's its own inverse, so unpacking is the same thing the other way around.
+void transpose16(uint16_t a[16]) {
+    uint16_t m = 0x00ff;
+    for (int j = 8; j != 0; j >>= 1, m ^= m << j) {
+        for (int k = 0; k < 16; k = (k + j + 1) & ~j) {
+            uint16_t t = (a[k] ^ (a[k + j] >> j)) & m;
+            a[k] ^= t;
+            a[k + j] ^= t << j;
+        }
+    }
+}
+
+void pack_lanes(uint64_t *planes, int lanes, int slot, const signal_t *values) {
+    int words = lanes / 64;
+    uint64_t *w = planes + (size_t)slot * 16 * words;
+    uint16_t a[16];
+
+    memset(w, 0, 16 * words * sizeof(uint64_t));
+    for (int l = 0; l < lanes; l += 16) {
+        for (int r = 0; r < 16; r++)
+            a[15 - r] = values[l + r];
+        transpose16(a);
+        for (int k = 0; k < 16; k++)
+            w[k * words + l / 64] |= (uint64_t)a[15 - k] << (l % 64);
+    }
+}
+
+void unpack_lanes(const uint64_t *planes, int lanes, int slot, signal_t *values) {
+    int words = lanes / 64;
+    const uint64_t *w = planes + (size_t)slot * 16 * words;
+    uint16_t a[16];
+
+    for (int l = 0; l < lanes; l += 16) {
+        for (int k = 0; k < 16; k++)
+            a[15 - k] = w[k * words + l / 64] >> (l % 64);
+        transpose16(a);
+        for (int r = 0; r < 16; r++)
+            values[l + r] = a[15 - r];
+    }
+}
+
+// Runs the plan once per lane, with its input i set to values[i * lanes + l]
+// in lane l, and reads the target out of every lane into results.
+void run_batch(batch_plan *plan, const batch_engine *e, void *planes, const signal_t *values, signal_t *results) {
+    for (int i = 0; i < plan->input_count; i++) {
+        if (plan->input_slots[i] >= 0)
+            pack_lanes(planes, e->lanes, plan->input_slots[i], values + (size_t)i * e->lanes);
+    }
+
+    e->run(plan->gates, plan->gate_count, planes);
+    eval_count += plan->gate_count;
+
+    unpack_lanes(planes, e->lanes, plan->target_slot, results);
+}
+
+// Native code. The generated function runs the circuit count times, once per
+// set of inputs, inputs[n * input_count + i] going to input_wires[i], and
+// puts the target of each run in outputs[n].
+typedef void (*native_fn)(int count, const signal_t *inputs, signal_t *outputs);
+
+typedef struct {
+    void *library;
+    native_fn run;
+    int input_count;
+} native_circuit;
+
+void emit_native_source(program *p, FILE *out, int input_count, int *input_wires, int target) {
+    fprintf(out, "// generated by day07, one local per wire in gate order\n");
+    fprintf(out, "void circuit(int count, const unsigned short *inputs, unsigned short *outputs) {\n");
+    fprintf(out, "    for (int n = 0; n < count; n++) {\n");
+    fprintf(out, "        const unsigned short *in = inputs + n * %d;\n", input_count);
+
+    for (gate *g = p->gates; g < p->gates + p->gate_count; g++) {
+        int input = -1;
+        for (int i = 0; i < input_count; i++) {
+            if (input_wires[i] == g->dest)
+                input = i;
+        }
+
+        fprintf(out, "        unsigned short w%d = ", g->dest);
+        if (input >= 0) {
+            fprintf(out, "in[%d];\n", input);
+            continue;
+        }
+        switch (g->op) {
+            case op_CONST:  fprintf(out, "%d;\n", g->a); break;
+            case op_SET:    fprintf(out, "w%d;\n", g->a); break;
+            case op_AND:    fprintf(out, "w%d & w%d;\n", g->a, g->b); break;
+            case op_OR:     fprintf(out, "w%d | w%d;\n", g->a, g->b); break;
+            case op_LSHIFT: fprintf(out, "w%d << %d;\n", g->a, g->b); break;
+            case op_RSHIFT: fprintf(out, "w%d >> %d;\n", g->a, g->b); break;
+            case op_NOT:    fprintf(out, "~w%d;\n", g->a); break;
+        }
+    }
+
+    fprintf(out, "        outputs[n] = w%d;\n", target);
+    fprintf(out, "    }\n}\n");
+}
+
+// writes the source into a fresh temp folder, compiles it there, loads it,
+// and cleans up after itself
+bool compile_native(program *p, int input_count, int *input_wires, int target, native_circuit *native) {
+    char folder[] = "/tmp/day07.XXXXXX";
+    char source[64], library[64], command[256];
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+
+    if (!mkdtemp(folder)) {
+        fprintf(stderr, "error: cannot make a temp folder for the native code.\n");
+        return false;
+    }
+    sprintf(source, "%s/circuit.c", folder);
+    sprintf(library, "%s/circuit.so", folder);
+
+    FILE *out = fopen(source, "w");
+    if (!out) {
+        fprintf(stderr, "error: cannot write '%s'.\n", source);
+        rmdir(folder);
+        return false;
+    }
+    emit_native_source(p, out, input_count, input_wires, target);
+    fclose(out);
+
+    snprintf(command, sizeof(command), "%s -O2 -shared -fPIC -o %s %s", cc, library, source);
+    bool ok = system(command) == 0;
+    if (!ok)
+        fprintf(stderr, "error: '%s' failed.\n", command);
+
+    native->library = ok ? dlopen(library, RTLD_NOW) : NULL;
+    native->run = native->library ? (native_fn)dlsym(native->library, "circuit") : NULL;
+    native->input_count = input_count;
+    if (ok && !native->run) {
+        fprintf(stderr, "error: cannot load the native code, %s\n", dlerror());
+        ok = false;
+    }
+
+    // once it's loaded the files aren't needed anymore
+    unlink(source);
+    unlink(library);
+    rmdir(folder);
+    return ok;
+}
+
+void free_native(native_circuit *native) {
+    if (native->library)
+        dlclose(native->library);
+}
+
 int main(int argc, char **argv) {
     FILE *input = stdin;
     char arg[128];
+    bool recursive = false;
+    int what_ifs = 0;
+    int batch_count = 0;
+    char *engine_name = NULL;
+    int thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int repeat = 0;
+    int native_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            char *mode = argv[++i];
+            if (strcmp(mode, "recursive") == 0)
+                recursive = true;
+            else if (strcmp(mode, "bytecode") == 0)
+                recursive = false;
+            else {
+                fprintf(stderr, "error: unknown mode '%s'.\n", mode);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            what_ifs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+            batch_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+            engine_name = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            thread_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            native_count = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-m bytecode|recursive] [-t threads] [-r count] [-w count] [-v count] [-e engine] [-n count] < input\n", argv[0]);
+            return 1;
+        }
+    }
 
     while (fgets(arg, sizeof(arg) - 1, input)) {
         trim(arg);
         char *sym = crack_symbol(arg);
         char *exp = crack_expression(arg);
-        add_instruction(sym, exp);
+        if (sym && exp)
+            add_instruction(sym, exp);
+        free(sym);
+        free(exp);
     }
 
+    // both parts need 'a' to read and 'b' to override
+    char *needed[] = { "a", "b" };
+    for (int i = 0; i < 2; i++) {
+        if (!find_instruction_for_symbol(needed[i])) {
+            fprintf(stderr, "error: cannot find symbol '%s' in the instruction table.\n", needed[i]);
+            return 1;
+        }
+    }
+
+    double start = wall_seconds();
+
     // part 1: just calc the value for symbol 'a'
     char *target_sym = "a";
-    signal_t result = evaluate_symbol_value(target_sym);
+    signal_t result;
+    program prog;
+
+    if (recursive)
+        result = evaluate_symbol_value(target_sym);
+    else {
+        if (!compile_program(&prog))
+            return 1;
+        run_program_threaded(&prog, thread_count);
+        result = prog.values[wire_for_symbol(target_sym)];
+    }
     printf("Part 1: '%s' evaluates to %u\n", target_sym, result);
 
+    if (!recursive && repeat > 0) {
+        double runs_start = wall_seconds();
+        for (int i = 0; i < repeat; i++)
+            run_program_threaded(&prog, thread_count);
+        double seconds = wall_seconds() - runs_start;
+        printf("Runs: %d gates in %d levels, %d threads, %.0lf gates/sec\n",
+            prog.gate_count, prog.level_count, MAX(1, MIN(thread_count, MAX_THREADS)),
+            (double)prog.gate_count * repeat / seconds);
+    }
+
     // part 2:
     //     "Now, take the signal you got on wire a, override wire b to that
     //      signal, and reset the other wires (including wire a). What new
     //      signal is ultimately provided to wire a?"
     // so now 'a' has a value, clear all the instruction cached values, replace
     // the 'b' expression with a constant of that value, and run for 'a' again.
-    for (int i = 0; i < instruction_count; i++) {
-        instructions[i].evaluated = false;
-        instructions[i].value = 0;
-    }
+    // compiled, that's just turning b's gate into a constant and updating
+    // whatever is downstream of it.
     instruction *b_instr = find_instruction_for_symbol("b");
-    char *prev = b_instr->exp;
     char b_expression[20];
     sprintf(b_expression, "%u", result);
-    b_instr->exp = b_expression;
-    // printf("...replacing %s's '%s' with '%s'\n", b_instr->sym, prev, b_instr->exp);
-    result = evaluate_symbol_value(target_sym);
-    printf("Part 2: '%s' by replacing 'b' with %s evaluates to %u\n", target_sym, b_instr->exp, result);
+
+    if (recursive) {
+        for (int i = 0; i < instruction_count; i++) {
+            instructions[i].evaluated = false;
+            instructions[i].value = 0;
+        }
+        b_instr->exp = b_expression;
+        result = evaluate_symbol_value(target_sym);
+    }
+    else {
+        int b_wire = b_instr - instructions;
+        override_wires(&prog, 1, &b_wire, &result);
+        keep_overrides(&prog, 1, &b_wire);
+        result = prog.values[wire_for_symbol(target_sym)];
+    }
+    printf("Part 2: '%s' by replacing 'b' with %s evaluates to %u\n", target_sym, b_expression, result);
+
+    // what-ifs: override a random wire with a random signal, see what 'a'
+    // does, and put it back. a full run would be gate_count every time.
+    if (!recursive && what_ifs > 0) {
+        long before = eval_count;
+        unsigned changed = 0;
+
+        srand(7);
+        for (int i = 0; i < what_ifs; i++) {
+            int wire = rand() % instruction_count;
+            signal_t value = rand();
+            signal_t was = prog.values[wire_for_symbol(target_sym)];
+            override_wires(&prog, 1, &wire, &value);
+            changed += prog.values[wire_for_symbol(target_sym)] != was;
+            restore_wires(&prog, 1, &wire);
+        }
+        printf("What-ifs: %d overrides changed '%s' %u times, %.1lf evaluations each (vs %d for a full run)\n",
+            what_ifs, target_sym, changed, (double)(eval_count - before) / what_ifs, prog.gate_count);
+    }
+
+    // batches: run b = 0, 1, 2... through, a batch of lanes at a time, and
+    // check the first batch against doing them one at a time
+    if (!recursive && batch_count > 0) {
+        int b_wire = b_instr - instructions, a_wire = wire_for_symbol(target_sym);
+        batch_plan plan;
+        if (!plan_batch(&prog, 1, &b_wire, a_wire, &plan))
+            return 1;
+
+        const batch_engine *e = select_batch_engine(engine_name);
+        if (!e)
+            return 1;
+
+        void *planes = alloc_planes(&plan, e);
+        signal_t *values = malloc(e->lanes * sizeof(signal_t));
+        signal_t *results = malloc(e->lanes * sizeof(signal_t));
+        int mismatches = 0;
+        unsigned checksum = 0;
+        double batch_start = wall_seconds();
+
+        for (int done = 0; done < batch_count; done += e->lanes) {
+            for (int l = 0; l < e->lanes; l++)
+                values[l] = done + l;
+            run_batch(&plan, e, planes, values, results);
+            for (int l = 0; l < e->lanes; l++)
+                checksum = checksum * 31 + results[l];
+        }
+
+        double seconds = wall_seconds() - batch_start;
+
+        // checking is a bytecode update per lane, so it's kept out of the timing
+        for (int l = 0; l < e->lanes; l++)
+            values[l] = l;
+        run_batch(&plan, e, planes, values, results);
+        for (int l = 0; l < e->lanes; l++) {
+            override_wires(&prog, 1, &b_wire, &values[l]);
+            mismatches += prog.values[a_wire] != results[l];
+        }
+        int vectors = (batch_count + e->lanes - 1) / e->lanes * e->lanes;
+        printf("Batch: %d values of 'b' on the %s engine (%d lanes), %d of %d gates in %d slots, checksum %08x, %.0lf vectors/sec\n",
+            vectors, e->name, e->lanes, plan.gate_count, prog.gate_count, plan.slot_count, checksum, vectors / seconds);
+        if (mismatches)
+            fprintf(stderr, "error: %d lanes of the first batch don't match the bytecode.\n", mismatches);
+
+        free(planes);
+        free(values);
+        free(results);
+        free_batch_plan(&plan);
+    }
+
+    // native: the same b = 0, 1, 2... as the batches, all in one call, checked
+    // against the bytecode. then some of them the old recursive way, which
+    // has to forget everything and re-parse b's expression for every one.
+    if (!recursive && native_count > 0) {
+        native_circuit native;
+        int b_wire = b_instr - instructions, a_wire = wire_for_symbol(target_sym);
+
+        double compile_start = wall_seconds();
+        if (!compile_native(&prog, 1, &b_wire, a_wire, &native))
+            return 1;
+        double compile_seconds = wall_seconds() - compile_start;
+
+        signal_t *values = malloc(native_count * sizeof(signal_t));
+        signal_t *results = malloc(native_count * sizeof(signal_t));
+        for (int i = 0; i < native_count; i++)
+            values[i] = i;
+
+        double native_start = wall_seconds();
+        native.run(native_count, values, results);
+        double native_seconds = wall_seconds() - native_start;
+
+        int mismatches = 0;
+        for (int i = 0; i < MIN(native_count, 4096); i++) {
+            override_wires(&prog, 1, &b_wire, &values[i]);
+            mismatches += prog.values[a_wire] != results[i];
+        }
+        if (mismatches)
+            fprintf(stderr, "error: %d native results don't match the bytecode.\n", mismatches);
+
+        int recursive_count = MIN(native_count, 1000);
+        char *prev = b_instr->exp;
+        mismatches = 0;
+        double recursive_start = wall_seconds();
+        for (int i = 0; i < recursive_count; i++) {
+            for (int k = 0; k < instruction_count; k++)
+                instructions[k].evaluated = false;
+            sprintf(b_expression, "%u", values[i]);
+            b_instr->exp = b_expression;
+            mismatches += evaluate_symbol_value(target_sym) != results[i];
+        }
+        double recursive_seconds = wall_seconds() - recursive_start;
+        b_instr->exp = prev;
+        if (mismatches)
+            fprintf(stderr, "error: %d native results don't match the recursive ones.\n", mismatches);
+
+        printf("Native: compiled in %.3lf seconds, %d values of 'b' at %.0lf/sec, vs %.0lf/sec recursive\n",
+            compile_seconds, native_count, native_count / native_seconds, recursive_count / recursive_seconds);
+
+        free_native(&native);
+        free(values);
+        free(results);
+    }
+
+    if (!recursive)
+        free_program(&prog);
+
+    printf("%s: %ld evaluations in %lf seconds\n", recursive ? "recursive" : "bytecode",
+        eval_count, wall_seconds() - start);
 
     return 0;
 }
@@ -23,12 +23,44 @@
 // Part 2 is finding the longest distance. Santa is showing off. Refactored the
 // recursive permutation walker to use a comparator function pointer. Also, as
 // seems to be common for me, macros and global variables.
+//
+// Update: O(n!) means anything past about a dozen cities takes forever. So now
+// there's a Held-Karp dynamic programming solver too, which is O(n^2 * 2^n). It
+// builds up the best path for every subset of cities ending at every city, one
+// more city at a time, then walks the choices back to recover the journey. It's
+// the default, '-m brute' gets the old permutation walker. The memory is the
+// catch, 5 bytes per subset per city, so it tops out at TSP_MAX_DP_NODES cities,
+// set in tsp.h.
+//
+// Update: brute force is still handy to check the dp answers, so it's threaded
+// now. The permutations are split up by their first two cities into jobs, each
+// thread keeps its own best, and those get compared once everyone's done.
+//
+// Update: '-m bnb' is a branch and bound walker that carries the distance down
+// the recursion and finds the shortest and longest in a single pass, cutting
+// off any partial journey that can't possibly beat either one.
+//
+// Update: day13 had its own copies of all of this, so the solvers, the distance
+// table and the city names moved out into tsp.c, which both days use. The
+// journey here is an open path; every solver now finds the shortest and the
+// longest in the one call, and '-t' threads brute force and bnb alike.
+//
+// Update: the same input format works for delivery graphs with thousands of
+// locations, which none of the exact solvers will ever finish. '-m heuristic'
+// starts from a nearest neighbour route and improves it with 2-opt and Or-opt
+// moves until '-b' seconds are up, then reports how far it might be from a
+// spanning tree bound. The city names are hashed now too, since looking each
+// one up in a list was the slow part of reading a million lines. The distance
+// table only gets printed when it would fit on a screen.
 
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <time.h>
+#include <sys/param.h>
+#include "tsp.h"
 
 char *trim(char *str) {
     char *p = str + (strlen(str) - 1);
@@ -38,108 +70,42 @@ char *trim(char *str) {
     return str;
 }
 
-#define MAX_CITIES      20
-
-typedef char hash_t;
-
-int city_count = 0;
-char *cities[MAX_CITIES];
-#define add_city(c)         city_count; cities[city_count++] = strdup(c)
-#define city_from_hash(h)   (cities[h % city_count])
-
-hash_t hash_from_city(char *city) {
-    for (int i = 0; i < city_count; i++) {
-        if (strcmp(city, cities[i]) == 0)
-            return (hash_t)i;
-    }
-    return -1;
-}
-
-hash_t safe_add_city(char *city) {
-    hash_t hash = 0;
-
-    if ((hash = hash_from_city(city)) == -1) {
-        hash = add_city(city);
-    }
-
-    return hash;
-}
+name_table cities;
+cost_matrix distances;
 
-int distances[MAX_CITIES * MAX_CITIES];
+#define city_count          (cities.count)
+#define city_from_hash(h)   (cities.names[h])
+#define get_distance(from, to)      get_cost(&distances, from, to)
 
-#define get_distance(from, to)      *(distances + from + (to * MAX_CITIES))
-#define set_distance(from, to, d)   *(distances + from + (to * MAX_CITIES)) = d
+#define MAX_TABLE_CITIES    12
 
 void add_distance(char *str) {
     int distance;
     char from[40], to[40];
-    if (sscanf(str, "%s to %s = %d", from, to, &distance) < 3)
+    if (sscanf(str, "%s to %s = %d", from, to, &distance) < 3) {
         fprintf(stderr, "error: cannot parse '%s'\n", str);
-    hash_t f = safe_add_city(from);
-    hash_t t = safe_add_city(to);
-
-    set_distance(f, t, distance);
-    set_distance(t, f, distance);
-}
-
-hash_t final_journey[MAX_CITIES];
-int shortest_distance = 1000000;
-int longest_distance = 0;
-
-#define swap(a, b)      { hash_t tmp; tmp = a; a = b; b = tmp; }
-
-int calculate_distance(hash_t *cities, int end) {
-    int distance = 0;
-    for (int i = 0; i < end; i++) {
-        distance += get_distance(cities[i], cities[i + 1]);
+        return;
     }
+    int f = name_intern(&cities, from);
+    int t = name_intern(&cities, to);
 
-    return distance;
-}
-
-void explore_journey(hash_t *cities, int start, int end, bool (*compare)(int dist)) {
-    if (start == end) {
-        // see if the distance is shortest, if so then...
-        int dist = calculate_distance(cities, end);
-        if (compare(dist)) {
-            memcpy(final_journey, cities, (end + 1) * sizeof(hash_t));
-        }
-    }
-    else {
-        for (int i = start; i <= end; i++) {
-            swap(cities[i], cities[start]);
-            explore_journey(cities, start + 1, end, compare);
-            swap(cities[i], cities[start]);
-        }
+    if (f < 0 || t < 0 || !cost_matrix_resize(&distances, city_count)) {
+        fprintf(stderr, "error: cannot add the distance from %s to %s.\n", from, to);
+        exit(1);
     }
-}
 
-bool shortest_comparator(int dist) {
-    if (dist < shortest_distance) {
-        shortest_distance = dist;
-        return true;
-    }
-    return false;
+    set_cost(&distances, f, t, distance);
+    set_cost(&distances, t, f, distance);
 }
 
-bool longest_comparator(int dist) {
-    if (dist > longest_distance) {
-        longest_distance = dist;
-        return true;
-    }
-    return false;
+// clock() is cpu time summed across all threads, so use wall time instead
+double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-int main(int argc, char **argv) {
-    FILE *input = stdin;
-    char arg[128];
-
-    while (fgets(arg, sizeof(arg) - 1, input)) {
-        trim(arg);
-        add_distance(arg);
-    }
-
-    // dump the distance table
+void dump_distances() {
     printf("              ");
     for (int city = 0; city < city_count; city++)
         printf("- %-13s", city_from_hash(city));
@@ -153,27 +119,73 @@ int main(int argc, char **argv) {
         }
         printf("\n");
     }
+}
+
+void dump_journey(char *label, tour *journey) {
+    printf("\n%s distance %d: %s", label, journey->cost, city_from_hash(journey->order[0]));
+    for (int city = 1; city < journey->count; city++)
+        printf(" -%d- %s", get_distance(journey->order[city - 1], journey->order[city]),
+            city_from_hash(journey->order[city]));
+    if (journey->bound != journey->cost)
+        printf("\n%s distance is within %.2lf%% of the bound, %d", label,
+            100.0 * abs(journey->cost - journey->bound) / MAX(abs(journey->bound), 1), journey->bound);
+}
+
+int main(int argc, char **argv) {
+    FILE *input = stdin;
+    char arg[128];
+    tsp_options opt;
+    tour shortest, longest;
+
+    tsp_options_init(&opt, path_OPEN);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if (!parse_solver(argv[++i], &opt.solver)) {
+                fprintf(stderr, "error: unknown mode '%s'.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            opt.thread_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            opt.time_budget = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-m dp|bnb|brute|heuristic] [-t threads] [-b seconds] < input\n", argv[0]);
+            return 1;
+        }
+    }
+
+    name_table_init(&cities);
+    cost_matrix_init(&distances, true);
+
+    while (fgets(arg, sizeof(arg) - 1, input)) {
+        trim(arg);
+        add_distance(arg);
+    }
+
+    if (city_count <= MAX_TABLE_CITIES)
+        dump_distances();
+
+    tour_init(&shortest);
+    tour_init(&longest);
 
-    // setup a working journey buffer for the permutations to be explored
-    hash_t *working_journey = calloc(city_count, sizeof(hash_t));
-    for (int i = 0; i < city_count; i++)
-        working_journey[i] = i;
+    double start = wall_seconds();
 
-    // explore the permutations, with the comparator looking for the shortest
-    explore_journey(working_journey, 0, city_count - 1, shortest_comparator);
+    if (!tsp_solve(&distances, &opt, &shortest, &longest))
+        return 1;
 
-    // Dump the final shortest journey
-    printf("\nshortest distance %d: %s", shortest_distance, city_from_hash(final_journey[0]));
-    for (int city = 1; city < city_count; city++)
-        printf(" -%d- %s", get_distance(final_journey[city - 1], final_journey[city]), city_from_hash(final_journey[city]));
+    double end = wall_seconds();
 
-    // explore the permutations, with the comparator looking for the longest
-    explore_journey(working_journey, 0, city_count - 1, longest_comparator);
+    dump_journey("shortest", &shortest);
+    dump_journey("longest", &longest);
+    printf("\nsolved %d cities with %s in %lf seconds, %ld evaluations\n",
+        city_count, solver_name(opt.solver), end - start, opt.evaluations);
 
-    // Dump the final longest journey
-    printf("\nlongest distance %d: %s", longest_distance, city_from_hash(final_journey[0]));
-    for (int city = 1; city < city_count; city++)
-        printf(" -%d- %s", get_distance(final_journey[city - 1], final_journey[city]), city_from_hash(final_journey[city]));
+    tour_free(&shortest);
+    tour_free(&longest);
+    cost_matrix_free(&distances);
+    name_table_free(&cities);
 
     return 0;
 }
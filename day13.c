@@ -25,46 +25,65 @@
 // pairing. So...the answer would be 664 - 24 (frank <-> carol), or 640. That
 // turns out to be the right answer. So if trying to optimize, I could just find
 // the lowest pairing and stick myself in there.
+//
+// Update: the brute force search is threaded now, same as day09. The seatings
+// are split up by who's in the first two seats, each thread keeps its own best
+// and count, and those are compared and added up once everyone's done.
+//
+// Update: finally exploited the circle. Pinning the first seat and skipping the
+// mirror image of every table leaves (n-1)!/2 seatings instead of n!, so the
+// brute force does 10-20x fewer evaluations. For bigger parties there's a
+// Held-Karp dp for the round table, O(n^2 * 2^n), which is the default now and
+// can seat one more than TSP_MAX_DP_NODES, in tsp.h, since the first seat is
+// pinned. '-m brute' still gets the permutations.
+//
+// Update: part 2 no longer starts from scratch. I got lucky with the "sit in the
+// weakest pair" idea, it isn't always right, but there's a cheap bound that
+// proves when an insertion is optimal. So a new guest goes into the best spot
+// at the solved table, and only if the bound says that might not be optimal
+// does the whole table get solved again. '-g file' adds more guests that way.
+//
+// Update: the names, the happiness table and the solvers all moved to tsp.c,
+// shared with day09, so there's only one copy of each speedup. The raw table is
+// still one-way, who likes whom, and the solvers get the net table built from
+// it: symmetric, as a closed tour, for the highest total. '-m bnb' works here
+// too now, and there's no fixed cap on the number of eaters anymore.
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <sys/param.h>
+#include "tsp.h"
 
-#define MAX_EATERS      10
 #define MAX_NAME_LENGTH 20
 
-typedef char hash_t;
+name_table eaters;
+cost_matrix happiness;          // one-way, from likes to by this much
 
-int eater_count = 0;
-char *all_eaters[MAX_EATERS];
+#define eater_count             (eaters.count)
+#define eater_from_hash(h)      (eaters.names[(h) % eater_count])
 
-#define eater_from_hash(h)   (all_eaters[h % eater_count])
+#define get_happiness(from, to)     get_cost(&happiness, from, to)
+#define set_happiness(from, to, h)  set_cost(&happiness, from, to, h)
 
-hash_t hash_from_eater(char *eater) {
-    for (int i = 0; i < eater_count; i++) {
-        if (strcmp(eater, all_eaters[i]) == 0)
-            return (hash_t)i;
-    }
-    return -1;
-}
+#define net_happiness(from, to)     ((get_happiness(from, to))+(get_happiness(to, from)))
 
-hash_t add_eater(char *eater) {
-    hash_t hash = 0;
+int add_eater(char *eater) {
+    int hash = name_intern(&eaters, eater);
 
-    if ((hash = hash_from_eater(eater)) == -1) {
-        hash = eater_count;
-        all_eaters[eater_count++] = strdup(eater);
+    if (hash < 0 || !cost_matrix_resize(&happiness, eater_count)) {
+        fprintf(stderr, "error: cannot add eater %s.\n", eater);
+        exit(1);
     }
 
     return hash;
 }
 
-int happiness[MAX_EATERS * MAX_EATERS];
-
-#define get_happiness(from, to)      (*(happiness + from + (to * MAX_EATERS)))
-#define set_happiness(from, to, h)   *(happiness + from + (to * MAX_EATERS)) = h
-
-void parse_happiness(char *str) {
+// The first 'seated' eaters are already at the solved table, and only the new
+// guests get fitted in around them, so nothing between two of them can change.
+void parse_happiness(char *str, int seated) {
     char from[MAX_NAME_LENGTH], to[MAX_NAME_LENGTH];
     int happy = 0;
 
@@ -73,62 +92,118 @@ void parse_happiness(char *str) {
     }
     else if (sscanf(str, "%s would gain %d happiness units by sitting next to %[^.].\n", from, &happy, to) != 3) {
         fprintf(stderr, "error: cannot parse input string: %s\n", str);
+        return;
     }
 
-    hash_t f = add_eater(from);
-    hash_t t = add_eater(to);
+    int f = add_eater(from);
+    int t = add_eater(to);
 
+    if (f < seated && t < seated) {
+        fprintf(stderr, "error: %s and %s are both seated already, ignoring that line.\n", from, to);
+        return;
+    }
     set_happiness(f, t, happy);
 }
 
-hash_t final_seating[MAX_EATERS];
-int max_happiness = 0;
+// final_seating.order has the table, final_seating.cost its happiness
+tour final_seating;
+#define max_happiness   (final_seating.cost)
+
+void list_eaters(int *seating, int max) {
+    printf("  ");
+    for (int i = 0; i < max; i++) {
+        printf("%s, ", eater_from_hash(seating[i]));
+    }
+    printf("%s\n", eater_from_hash(seating[max]));
+}
 
-#define swap(a, b)      { hash_t tmp; tmp = a; a = b; b = tmp; }
+long evaluations = 0;
 
-#define net_happiness(from, to)     ((get_happiness(from, to))+(get_happiness(to, from)))
+// The solvers only care about the pair, not who likes whom more, so they get
+// the net happiness for each pair, which is the same both ways.
+bool solve_seating(tsp_options *opt) {
+    cost_matrix net;
+    bool ok;
 
-int calculate_happiness(hash_t *eaters, int end) {
-    int happy = 0;
-    for (int i = 0; i < end; i++) {
-        happy += net_happiness(eaters[i], eaters[i + 1]);
+    cost_matrix_init(&net, true);
+    if (!cost_matrix_resize(&net, eater_count)) {
+        fprintf(stderr, "error: cannot allocate memory for %d eaters.\n", eater_count);
+        return false;
+    }
+    for (int from = 0; from < eater_count; from++) {
+        for (int to = 0; to < eater_count; to++)
+            set_cost(&net, from, to, from == to ? 0 : net_happiness(from, to));
     }
 
-    happy += net_happiness(eaters[end], eaters[0]);
+    ok = tsp_solve(&net, opt, NULL, &final_seating);
+    evaluations += opt->evaluations;
 
-    return happy;
+    cost_matrix_free(&net);
+    return ok;
 }
 
-void list_eaters(hash_t *eaters, int max) {
-    printf("  ");
-    for (int i = 0; i < max; i++) {
-        printf("%s, ", eater_from_hash(eaters[i]));
+// Seats one more guest at the optimal table in final_seating, which has the
+// first 'seated' eaters at it, by putting them between the pair where they add
+// the most. That's only a guess in general, so it comes with a check. Take any
+// table with the guest sitting between x and y. Without the guest, it's a row
+// from x to y, and closing that row up into a table can't beat the old best,
+// so the row is worth at most max_happiness - net(x,y). So no table with the
+// guest can beat the best of max_happiness - net(x,y) + net(x,g) + net(g,y)
+// over *every* pair x,y. If the insertion hits that bound, it's optimal, and
+// if not, it says so and the caller has to solve it the long way.
+bool insert_guest(int seated, int guest) {
+    int best_gain = INT_MIN, best_seat = 0;
+    int bound = INT_MIN;
+
+    if (seated < 2)
+        return false;
+
+    for (int i = 0; i < seated; i++) {
+        int x = final_seating.order[i], y = final_seating.order[(i + 1) % seated];
+        int gain = net_happiness(x, guest) + net_happiness(guest, y) - net_happiness(x, y);
+        evaluations++;
+        if (gain > best_gain) {
+            best_gain = gain;
+            best_seat = i;
+        }
     }
-    printf("%s\n", eater_from_hash(eaters[max]));
-}
 
-int evaluations = 0;
+    for (int x = 0; x < seated; x++) {
+        for (int y = x + 1; y < seated; y++) {
+            int gain = net_happiness(x, guest) + net_happiness(guest, y) - net_happiness(x, y);
+            evaluations++;
+            bound = MAX(bound, gain);
+        }
+    }
 
-void explore_journey(hash_t *eaters, int start, int end) {
-    if (start == end) {
-        evaluations++;
-        int happy = calculate_happiness(eaters, end);
+    if (best_gain < bound)
+        return false;
 
-        // printf("found the end, %d: ", happy);
-        // list_eaters(eaters, end);
+    if (!tour_resize(&final_seating, seated + 1))
+        return false;
+    memmove(final_seating.order + best_seat + 2, final_seating.order + best_seat + 1,
+            (seated - best_seat - 1) * sizeof(int));
+    final_seating.order[best_seat + 1] = guest;
+    max_happiness += best_gain;
 
-        if (happy > max_happiness) {
-            max_happiness = happy;
-            memcpy(final_seating, eaters, (end + 1) * sizeof(hash_t));
-        }
-    }
-    else {
-        for (int i = start; i <= end; i++) {
-            swap(eaters[i], eaters[start]);
-            explore_journey(eaters, start + 1, end);
-            swap(eaters[i], eaters[start]);
+    return true;
+}
+
+// Adds the eaters from first_guest on to the table that's already solved for
+// everyone before them, one at a time. As soon as one can't be proven by
+// insertion, the whole table gets solved again with everyone at once. The
+// proof needs the table to have been optimal, which the heuristic's isn't.
+bool add_guests(int first_guest, tsp_options *opt, bool *inserted) {
+    *inserted = true;
+
+    for (int g = first_guest; g < eater_count; g++) {
+        if (opt->solver == solver_HEURISTIC || !insert_guest(g, g)) {
+            *inserted = false;
+            return solve_seating(opt);
         }
     }
+
+    return true;
 }
 
 void dump_eaters() {
@@ -156,11 +231,11 @@ void dump_happiness_table() {
 
 void dump_seating() {
     for (int eater = 0; eater < eater_count; eater++) {
-        printf("%s\n", eater_from_hash(final_seating[eater]));
+        printf("%s\n", eater_from_hash(final_seating.order[eater]));
         printf(" ⬇️  %3d\n ------ %3d\n ⬆️  %3d\n",
-            get_happiness(final_seating[eater], final_seating[(eater + 1)%eater_count]),
-            net_happiness(final_seating[eater], final_seating[(eater + 1)%eater_count]),
-            get_happiness(final_seating[(eater + 1)%eater_count], final_seating[eater])
+            get_happiness(final_seating.order[eater], final_seating.order[(eater + 1)%eater_count]),
+            net_happiness(final_seating.order[eater], final_seating.order[(eater + 1)%eater_count]),
+            get_happiness(final_seating.order[(eater + 1)%eater_count], final_seating.order[eater])
             );
     }
 }
@@ -168,27 +243,52 @@ void dump_seating() {
 int main(int argc, char **argv) {
     FILE *input = stdin;
     char arg[128];
+    tsp_options opt;
+    char *guests_file = NULL;
+
+    tsp_options_init(&opt, path_CLOSED);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            opt.thread_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if (!parse_solver(argv[++i], &opt.solver)) {
+                fprintf(stderr, "error: unknown mode '%s'.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            opt.time_budget = atof(argv[++i]);
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+            guests_file = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [-m dp|bnb|brute|heuristic] [-t threads] [-b seconds] [-g guests] < input\n", argv[0]);
+            return 1;
+        }
+    }
+
+    name_table_init(&eaters);
+    cost_matrix_init(&happiness, false);
+    tour_init(&final_seating);
 
     while (fgets(arg, sizeof(arg) - 1, input)) {
-        parse_happiness(arg);
+        parse_happiness(arg, 0);
     }
 
     // dump_eaters();
     // dump_happiness_table();
 
-    hash_t *working_seats = calloc(eater_count, sizeof(hash_t));
-    for (int i = 0; i < eater_count; i++)
-        working_seats[i] = i;
-
-    explore_journey(working_seats, 0, eater_count - 1);
+    if (!solve_seating(&opt))
+        return 1;
 
     // dump_seating();
 
-    printf("Part 1: %d evaluations, greatest happiness %d:\n", evaluations, max_happiness);
-    list_eaters(final_seating, eater_count - 1);
+    printf("Part 1: %ld evaluations, greatest happiness %d:\n", evaluations, max_happiness);
+    list_eaters(final_seating.order, eater_count - 1);
 
-    // add 'me' to eaters and happiness
-    hash_t me = add_eater("Warren");
+    // add 'me' to eaters and happiness, then seat me at the table that's
+    // already solved instead of starting all over
+    int me = add_eater("Warren");
     for (int i = 0; i < eater_count - 1; i++) {
         set_happiness(i, me, 0);
         set_happiness(me, i, 0);
@@ -197,18 +297,43 @@ int main(int argc, char **argv) {
     // dump_eaters();
     // dump_happiness_table();
 
-    max_happiness = 0;
+    bool inserted;
+    if (!add_guests(me, &opt, &inserted))
+        return 1;
+
+    // dump_seating();
+
+    printf("Part 2: %ld evaluations, greatest happiness %d%s:\n", evaluations, max_happiness,
+        inserted ? " (by insertion)" : "");
+    list_eaters(final_seating.order, eater_count - 1);
+
+    // any more guests, in the same format as the input, get the same treatment.
+    // affinities that aren't given are 0, and ones between people already
+    // seated are turned away, since that table is settled.
+    if (guests_file) {
+        FILE *guests = fopen(guests_file, "r");
+        if (!guests) {
+            fprintf(stderr, "error: cannot open the guests file '%s'.\n", guests_file);
+            return 1;
+        }
 
-    working_seats = calloc(eater_count, sizeof(hash_t));
-    for (int i = 0; i < eater_count; i++)
-        working_seats[i] = i;
+        int first_guest = eater_count;
+        while (fgets(arg, sizeof(arg) - 1, guests)) {
+            parse_happiness(arg, first_guest);
+        }
+        fclose(guests);
 
-    explore_journey(working_seats, 0, eater_count - 1);
+        if (!add_guests(first_guest, &opt, &inserted))
+            return 1;
 
-    // dump_seating();
+        printf("More guests: %ld evaluations, greatest happiness %d%s:\n", evaluations, max_happiness,
+            inserted ? " (by insertion)" : "");
+        list_eaters(final_seating.order, eater_count - 1);
+    }
 
-    printf("Part 2: %d evaluations, greatest happiness %d:\n", evaluations, max_happiness);
-    list_eaters(final_seating, eater_count - 1);
+    tour_free(&final_seating);
+    cost_matrix_free(&happiness);
+    name_table_free(&eaters);
 
     return 0;
 }
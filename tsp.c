@@ -0,0 +1,869 @@
+// AOC 2015 solution in C
+// @chadsy
+// Copyright (C) 2021 Chad Royal
+// MIT License http://opensource.org/licenses/MIT
+//
+// Traveling salesperson helpers, shared by day09 and day13. See tsp.h.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <pthread.h>
+#include "tsp.h"
+
+void name_table_init(name_table *t) {
+    t->count = 0;
+    t->capacity = 0;
+    t->names = NULL;
+    t->slot_count = 0;
+    t->slots = NULL;
+}
+
+void name_table_free(name_table *t) {
+    for (int i = 0; i < t->count; i++)
+        free(t->names[i]);
+    free(t->names);
+    free(t->slots);
+    name_table_init(t);
+}
+
+// FNV-1a
+static unsigned name_hash(const char *name) {
+    unsigned h = 2166136261u;
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h;
+}
+
+// the slot a name is in, or the empty one it would go in
+static int name_slot(const name_table *t, const char *name) {
+    int mask = t->slot_count - 1;
+    int slot = name_hash(name) & mask;
+    while (t->slots[slot] && strcmp(name, t->names[t->slots[slot] - 1]) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+int name_lookup(const name_table *t, const char *name) {
+    if (t->slot_count == 0)
+        return -1;
+    return t->slots[name_slot(t, name)] - 1;
+}
+
+int name_intern(name_table *t, const char *name) {
+    int index = name_lookup(t, name);
+    if (index >= 0)
+        return index;
+
+    if (t->count == t->capacity) {
+        int capacity = t->capacity ? t->capacity * 2 : 16;
+        char **names = realloc(t->names, capacity * sizeof(char *));
+        if (!names) {
+            fprintf(stderr, "error: cannot allocate memory for %d names.\n", capacity);
+            return -1;
+        }
+        t->names = names;
+        t->capacity = capacity;
+    }
+
+    // keep the slots at most half full, rehashing everyone when they grow
+    if ((t->count + 1) * 2 > t->slot_count) {
+        int slot_count = t->slot_count ? t->slot_count * 2 : 32;
+        int *slots = calloc(slot_count, sizeof(int));
+        if (!slots) {
+            fprintf(stderr, "error: cannot allocate memory for %d names.\n", slot_count);
+            return -1;
+        }
+        free(t->slots);
+        t->slots = slots;
+        t->slot_count = slot_count;
+        for (int i = 0; i < t->count; i++)
+            t->slots[name_slot(t, t->names[i])] = i + 1;
+    }
+
+    t->names[t->count] = strdup(name);
+    t->slots[name_slot(t, name)] = t->count + 1;
+    return t->count++;
+}
+
+void cost_matrix_init(cost_matrix *m, bool symmetric) {
+    m->count = 0;
+    m->capacity = 0;
+    m->cost = NULL;
+    m->symmetric = symmetric;
+}
+
+void cost_matrix_free(cost_matrix *m) {
+    free(m->cost);
+    cost_matrix_init(m, m->symmetric);
+}
+
+// the rows are capacity wide, so growing means copying each old row over into
+// its new, wider spot
+bool cost_matrix_resize(cost_matrix *m, int count) {
+    if (count > m->capacity) {
+        int capacity = m->capacity ? m->capacity : 16;
+        while (capacity < count)
+            capacity *= 2;
+
+        int *cost = calloc((size_t)capacity * capacity, sizeof(int));
+        if (!cost) {
+            fprintf(stderr, "error: cannot allocate memory for %d nodes.\n", capacity);
+            return false;
+        }
+        for (int r = 0; r < m->count; r++)
+            memcpy(cost + (size_t)r * capacity, m->cost + (size_t)r * m->capacity, m->count * sizeof(int));
+
+        free(m->cost);
+        m->cost = cost;
+        m->capacity = capacity;
+    }
+
+    m->count = MAX(m->count, count);
+    return true;
+}
+
+void tour_init(tour *t) {
+    t->cost = 0;
+    t->bound = 0;
+    t->count = 0;
+    t->order = NULL;
+}
+
+void tour_free(tour *t) {
+    free(t->order);
+    tour_init(t);
+}
+
+bool tour_resize(tour *t, int count) {
+    int *order = realloc(t->order, MAX(count, 1) * sizeof(int));
+    if (!order) {
+        fprintf(stderr, "error: cannot allocate memory for a tour of %d.\n", count);
+        return false;
+    }
+    t->order = order;
+    t->count = count;
+    return true;
+}
+
+int tour_cost(const cost_matrix *m, path_shape shape, const int *order, int count) {
+    int cost = 0;
+    for (int i = 0; i + 1 < count; i++)
+        cost += get_cost(m, order[i], order[i + 1]);
+    if (shape == path_CLOSED && count > 0)
+        cost += get_cost(m, order[count - 1], order[0]);
+    return cost;
+}
+
+void tsp_options_init(tsp_options *opt, path_shape shape) {
+    opt->solver = solver_DP;
+    opt->shape = shape;
+    opt->thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    opt->time_budget = 1.0;
+    opt->evaluations = 0;
+}
+
+bool parse_solver(const char *name, tsp_solver *solver) {
+    if (strcmp(name, "brute") == 0)
+        *solver = solver_BRUTE;
+    else if (strcmp(name, "bnb") == 0)
+        *solver = solver_BNB;
+    else if (strcmp(name, "dp") == 0)
+        *solver = solver_DP;
+    else if (strcmp(name, "heuristic") == 0)
+        *solver = solver_HEURISTIC;
+    else
+        return false;
+    return true;
+}
+
+const char *solver_name(tsp_solver solver) {
+    switch (solver) {
+        case solver_BRUTE:  return "brute";
+        case solver_BNB:    return "bnb";
+        case solver_DP:     return "dp";
+        case solver_HEURISTIC:  return "heuristic";
+    }
+    return "(invalid)";
+}
+
+// Brute force and branch and bound are the same permutation walker, one just
+// prunes. The running cost is carried down as each node gets placed. Every node
+// not placed yet still has to be arrived at once (and a cycle has to arrive
+// back at its start), which costs at least that node's cheapest way in and at
+// most its dearest, so those sums bound how the rest of a tour can finish. A
+// subtree gets cut once it can't beat the lowest *or* the highest so far.
+//
+// A closed tour has its first node pinned, since spinning a cycle around makes
+// no difference. With symmetric costs a tour read backwards is the same tour,
+// and of each mirrored pair exactly one has node a placed before node b, so b
+// only gets placed once a has been.
+typedef struct {
+    const cost_matrix *m;
+    path_shape shape;
+    bool prune;
+    bool want_low, want_high;
+    bool mirror;
+    int mirror_a, mirror_b;
+    int pinned;                 // nodes fixed at the start of every tour
+    int *in_low, *in_high;      // cheapest and dearest way into each node
+    int rest_low, rest_high;    // their sums, for a tour with nothing placed
+    int job_count;
+    int next_job;
+    pthread_mutex_t lock;
+} walk_search;
+
+// Each thread keeps its own bests, so nothing is shared in the hot part of the
+// search. They get compared once everyone's done.
+typedef struct {
+    walk_search *search;
+    int low, high;
+    int *low_order, *high_order;
+    int *order;
+    long evaluations;
+} walk_best;
+
+#define swap(a, b)      { int tmp; tmp = a; a = b; b = tmp; }
+
+static void explore(walk_best *best, int *order, int start, int cost, int rest_low, int rest_high, bool a_placed) {
+    walk_search *s = best->search;
+    int n = s->m->count;
+
+    if (s->prune)
+        best->evaluations++;
+
+    if (start == n) {
+        if (s->shape == path_CLOSED)
+            cost += get_cost(s->m, order[n - 1], order[0]);
+        if (!s->prune)
+            best->evaluations++;
+
+        if (s->want_low && cost < best->low) {
+            best->low = cost;
+            memcpy(best->low_order, order, n * sizeof(int));
+        }
+        if (s->want_high && cost > best->high) {
+            best->high = cost;
+            memcpy(best->high_order, order, n * sizeof(int));
+        }
+        return;
+    }
+
+    // with nothing placed yet there's no tour to bound
+    if (s->prune && start > 0) {
+        bool can_low = s->want_low && cost + rest_low < best->low;
+        bool can_high = s->want_high && cost + rest_high > best->high;
+        if (!can_low && !can_high)
+            return;
+    }
+
+    for (int i = start; i < n; i++) {
+        int c = order[i];
+        if (s->mirror && c == s->mirror_b && !a_placed)
+            continue;
+
+        swap(order[i], order[start]);
+        int hop = (start > 0) ? get_cost(s->m, order[start - 1], c) : 0;
+        explore(best, order, start + 1, cost + hop, rest_low - s->in_low[c], rest_high - s->in_high[c],
+                a_placed || c == s->mirror_a);
+        swap(order[i], order[start]);
+    }
+}
+
+// The tours get split up by the first two free nodes, which makes f*(f-1) jobs
+// for f free nodes, plenty to keep the threads evenly busy. A thread grabs the
+// next job, places those two, and explores the rest on its own.
+#define PREFIX_LENGTH   2
+
+static void *walk_worker(void *arg) {
+    walk_best *best = arg;
+    walk_search *s = best->search;
+    int n = s->m->count;
+    int free_nodes = n - s->pinned;
+    int *order = best->order;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        int job = s->next_job++;
+        pthread_mutex_unlock(&s->lock);
+
+        if (job >= s->job_count)
+            break;
+
+        for (int i = 0; i < n; i++)
+            order[i] = i;
+
+        int start = s->pinned;
+        int cost = 0;
+        int rest_low = s->rest_low, rest_high = s->rest_high;
+        bool a_placed = start > 0 && order[0] == s->mirror_a;
+        bool mirrored = false;
+
+        if (free_nodes > PREFIX_LENGTH) {
+            int picks[PREFIX_LENGTH] = { job / (free_nodes - 1), job % (free_nodes - 1) };
+
+            for (int k = 0; k < PREFIX_LENGTH; k++, start++) {
+                int c = order[start + picks[k]];
+                if (s->mirror && c == s->mirror_b && !a_placed) {
+                    mirrored = true;
+                    break;
+                }
+
+                swap(order[start + picks[k]], order[start]);
+                cost += (start > 0) ? get_cost(s->m, order[start - 1], c) : 0;
+                rest_low -= s->in_low[c];
+                rest_high -= s->in_high[c];
+                a_placed = a_placed || c == s->mirror_a;
+            }
+        }
+
+        if (!mirrored)
+            explore(best, order, start, cost, rest_low, rest_high, a_placed);
+    }
+
+    return NULL;
+}
+
+static bool solve_walk(const cost_matrix *m, tsp_options *opt, tour *lowest, tour *highest) {
+    pthread_t threads[TSP_MAX_THREADS];
+    walk_best bests[TSP_MAX_THREADS];
+    walk_search s;
+    int n = m->count;
+    int thread_count = MAX(1, MIN(opt->thread_count, TSP_MAX_THREADS));
+
+    s.m = m;
+    s.shape = opt->shape;
+    s.prune = opt->solver == solver_BNB;
+    s.want_low = lowest != NULL;
+    s.want_high = highest != NULL;
+    s.pinned = (opt->shape == path_CLOSED) ? 1 : 0;
+    s.mirror_a = s.pinned;
+    s.mirror_b = s.pinned + 1;
+    s.mirror = m->symmetric && n - s.pinned >= 2;
+    s.in_low = malloc(n * sizeof(int));
+    s.in_high = malloc(n * sizeof(int));
+    s.rest_low = s.rest_high = 0;
+
+    // a cycle's pinned start gets arrived at too, at the very end, so it stays
+    // in the sums; an open path's first node is never arrived at, but it's
+    // taken off along with everything else as it's placed
+    for (int c = 0; c < n; c++) {
+        s.in_low[c] = (n > 1) ? INT_MAX : 0;
+        s.in_high[c] = (n > 1) ? INT_MIN : 0;
+        for (int from = 0; from < n; from++) {
+            if (from == c)
+                continue;
+            s.in_low[c] = MIN(s.in_low[c], get_cost(m, from, c));
+            s.in_high[c] = MAX(s.in_high[c], get_cost(m, from, c));
+        }
+        if (c >= s.pinned) {
+            s.rest_low += s.in_low[c];
+            s.rest_high += s.in_high[c];
+        }
+    }
+    if (s.pinned && n > 1) {
+        s.rest_low += s.in_low[0];
+        s.rest_high += s.in_high[0];
+    }
+
+    int free_nodes = n - s.pinned;
+    s.job_count = (free_nodes > PREFIX_LENGTH) ? free_nodes * (free_nodes - 1) : 1;
+    s.next_job = 0;
+    pthread_mutex_init(&s.lock, NULL);
+
+    for (int t = 0; t < thread_count; t++) {
+        bests[t].search = &s;
+        bests[t].low = INT_MAX;
+        bests[t].high = INT_MIN;
+        bests[t].low_order = calloc(n, sizeof(int));
+        bests[t].high_order = calloc(n, sizeof(int));
+        bests[t].order = calloc(n, sizeof(int));
+        bests[t].evaluations = 0;
+        pthread_create(&threads[t], NULL, walk_worker, &bests[t]);
+    }
+
+    walk_best *low = &bests[0], *high = &bests[0];
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(threads[t], NULL);
+        opt->evaluations += bests[t].evaluations;
+        if (bests[t].low < low->low)
+            low = &bests[t];
+        if (bests[t].high > high->high)
+            high = &bests[t];
+    }
+
+    bool ok = true;
+    if (lowest && (ok = tour_resize(lowest, n))) {
+        lowest->cost = low->low;
+        memcpy(lowest->order, low->low_order, n * sizeof(int));
+    }
+    if (highest && ok && (ok = tour_resize(highest, n))) {
+        highest->cost = high->high;
+        memcpy(highest->order, high->high_order, n * sizeof(int));
+    }
+
+    for (int t = 0; t < thread_count; t++) {
+        free(bests[t].low_order);
+        free(bests[t].high_order);
+        free(bests[t].order);
+    }
+    free(s.in_low);
+    free(s.in_high);
+    pthread_mutex_destroy(&s.lock);
+
+    return ok;
+}
+
+// Held-Karp. best[mask][last] is the best cost of a path that visits exactly the
+// nodes in mask and ends at last. Each one is built from the best path over mask
+// without last, ending at some other node, plus the hop over. For an open path
+// every node is in play and it can start anywhere. For a cycle node 0 is pinned
+// as the start, the masks are over everyone else, and the hops out of and back
+// into node 0 are added at either end. from[] remembers the choices, so the tour
+// can be walked back out from its last node. O(n^2 * 2^n), no permutations.
+static bool solve_held_karp(const cost_matrix *m, path_shape shape, bool highest, tour *t, long *evaluations) {
+    int n = m->count;
+    int pinned = (shape == path_CLOSED) ? 1 : 0;
+    int nodes = n - pinned;         // bit b of a mask is node b + pinned
+    int masks = 1 << nodes;
+    int worst = highest ? INT_MIN : INT_MAX;
+
+    if (!tour_resize(t, n))
+        return false;
+
+    if (nodes <= 0) {
+        t->order[0] = 0;
+        t->cost = tour_cost(m, shape, t->order, n);
+        return true;
+    }
+
+    int *best = malloc((size_t)masks * nodes * sizeof(int));
+    signed char *from = malloc((size_t)masks * nodes * sizeof(signed char));
+    if (!best || !from) {
+        fprintf(stderr, "error: cannot allocate memory for %d nodes.\n", n);
+        free(best);
+        free(from);
+        return false;
+    }
+
+    #define better(a, b)        (highest ? (a) > (b) : (a) < (b))
+    #define dp(mask, last)      best[(size_t)(mask) * nodes + (last)]
+    #define dp_from(mask, last) from[(size_t)(mask) * nodes + (last)]
+
+    for (int mask = 1; mask < masks; mask++) {
+        for (int last = 0; last < nodes; last++) {
+            if (!(mask & (1 << last)))
+                continue;
+
+            int rest = mask & ~(1 << last);
+            if (rest == 0) {
+                dp(mask, last) = pinned ? get_cost(m, 0, last + pinned) : 0;
+                dp_from(mask, last) = -1;
+                continue;
+            }
+
+            // only visit the nodes actually in rest, lowest bit first
+            int b = worst;
+            signed char prev = -1;
+            for (int bits = rest; bits; bits &= bits - 1) {
+                int p = __builtin_ctz(bits);
+                int c = dp(rest, p) + get_cost(m, p + pinned, last + pinned);
+                (*evaluations)++;
+                if (better(c, b)) {
+                    b = c;
+                    prev = p;
+                }
+            }
+            dp(mask, last) = b;
+            dp_from(mask, last) = prev;
+        }
+    }
+
+    int full = masks - 1;
+    int last = 0;
+    t->cost = worst;
+    for (int c = 0; c < nodes; c++) {
+        int cost = dp(full, c) + (pinned ? get_cost(m, c + pinned, 0) : 0);
+        if (better(cost, t->cost)) {
+            t->cost = cost;
+            last = c;
+        }
+    }
+
+    // walk the choices back from the end of the tour to the start
+    if (pinned)
+        t->order[0] = 0;
+    for (int mask = full, i = n - 1; i >= pinned; i--) {
+        t->order[i] = last + pinned;
+        int prev = dp_from(mask, last);
+        mask &= ~(1 << last);
+        last = prev;
+    }
+
+    #undef better
+    #undef dp
+    #undef dp_from
+
+    free(best);
+    free(from);
+    return true;
+}
+
+// The heuristic. Exact is hopeless past a couple dozen nodes, but a tour that's
+// close is cheap: start with nearest neighbour, then keep fixing it up with
+// local moves until none of them help. 2-opt takes out two hops and joins the
+// tour back up the other way, which reverses the stretch between them. Or-opt
+// picks up a run of 1 to 3 nodes and drops it in between some other pair,
+// either way around. Once neither finds anything, the best tour so far gets a
+// double bridge kick (cut in four and put back out of order, which 2-opt can't
+// undo in one move) and is fixed up again, and it's kept if it's no worse. That
+// goes on until the time runs out.
+//
+// It all works on a cycle. An open path gets one extra, dummy node whose hops
+// cost nothing, so the path is the cycle with the dummy taken back out. The
+// highest tour is the lowest one with the costs negated. The moves only work
+// out for symmetric costs, where reversing part of a tour doesn't change it.
+typedef struct {
+    const cost_matrix *m;
+    int n;                  // real nodes
+    int count;              // nodes in the cycle, n + 1 with the dummy
+    int sign;
+    int *order;
+    int *spare;
+    double deadline;
+    unsigned random;
+    long evaluations;
+} heuristic_search;
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define out_of_time(h)  (wall_seconds() >= (h)->deadline)
+
+static inline int hop_cost(const heuristic_search *h, int from, int to) {
+    if (from >= h->n || to >= h->n)
+        return 0;
+    return h->sign * get_cost(h->m, from, to);
+}
+
+static int cycle_cost(const heuristic_search *h, const int *order) {
+    int cost = 0;
+    for (int i = 0; i < h->count; i++)
+        cost += hop_cost(h, order[i], order[(i + 1) % h->count]);
+    return cost;
+}
+
+// xorshift, seeded the same every run, so a run is repeatable for a given budget
+static unsigned next_random(heuristic_search *h) {
+    h->random ^= h->random << 13;
+    h->random ^= h->random >> 17;
+    h->random ^= h->random << 5;
+    return h->random;
+}
+
+static void nearest_neighbour(heuristic_search *h, int start) {
+    int *placed = h->spare;
+
+    memset(placed, 0, h->n * sizeof(int));
+    h->order[0] = start;
+    placed[start] = 1;
+    for (int i = 1, at = start; i < h->n; i++) {
+        int next = -1;
+        for (int c = 0; c < h->n; c++) {
+            if (!placed[c] && (next < 0 || hop_cost(h, at, c) < hop_cost(h, at, next)))
+                next = c;
+        }
+        h->order[i] = at = next;
+        placed[next] = 1;
+    }
+    if (h->count > h->n)
+        h->order[h->n] = h->n;
+}
+
+// reverses the len nodes starting at position from, wrapping around the end
+static void reverse_run(heuristic_search *h, int from, int len) {
+    int a = from % h->count, b = (from + len - 1) % h->count;
+    for (int k = 0; k < len / 2; k++) {
+        swap(h->order[a], h->order[b]);
+        a = (a + 1) % h->count;
+        b = (b + h->count - 1) % h->count;
+    }
+}
+
+static bool two_opt(heuristic_search *h) {
+    int count = h->count;
+    int *order = h->order;
+    bool improved = false;
+
+    for (int i = 0; i + 2 < count && !out_of_time(h); i++) {
+        int a = order[i], b = order[i + 1];
+        int ab = hop_cost(h, a, b);
+
+        for (int j = i + 2; j < count; j++) {
+            if (i == 0 && j == count - 1)
+                continue;
+
+            int c = order[j], d = order[(j + 1) % count];
+            h->evaluations++;
+            if (hop_cost(h, a, c) + hop_cost(h, b, d) < ab + hop_cost(h, c, d)) {
+                // either side reverses to the same cycle, so do the shorter one
+                if ((j - i) * 2 <= count)
+                    reverse_run(h, i + 1, j - i);
+                else
+                    reverse_run(h, j + 1, count - (j - i));
+                improved = true;
+
+                a = order[i];
+                b = order[i + 1];
+                ab = hop_cost(h, a, b);
+            }
+        }
+    }
+
+    return improved;
+}
+
+// moves the len nodes starting at position from to go after position after
+static void move_run(heuristic_search *h, int from, int len, int after, bool reversed) {
+    int count = h->count, out = 0;
+
+    for (int k = (from + len) % count; k != from; k = (k + 1) % count) {
+        h->spare[out++] = h->order[k];
+        if (k == after) {
+            for (int r = 0; r < len; r++)
+                h->spare[out++] = h->order[(from + (reversed ? len - 1 - r : r)) % count];
+        }
+    }
+    memcpy(h->order, h->spare, count * sizeof(int));
+}
+
+static bool or_opt(heuristic_search *h) {
+    int count = h->count;
+    int *order = h->order;
+    bool improved = false;
+
+    for (int len = 1; len <= 3 && len + 3 <= count; len++) {
+        for (int i = 0; i < count && !out_of_time(h); i++) {
+            int before = (i + count - 1) % count, after = (i + len) % count;
+            int p = order[before], first = order[i], last = order[(i + len - 1) % count], q = order[after];
+            int saved = hop_cost(h, p, first) + hop_cost(h, last, q) - hop_cost(h, p, q);
+
+            for (int k = after; k != before; k = (k + 1) % count) {
+                int a = order[k], b = order[(k + 1) % count];
+                int ahead = hop_cost(h, a, first) + hop_cost(h, last, b);
+                int behind = hop_cost(h, a, last) + hop_cost(h, first, b);
+                h->evaluations++;
+                if (MIN(ahead, behind) - hop_cost(h, a, b) < saved) {
+                    move_run(h, i, len, k, behind < ahead);
+                    improved = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return improved;
+}
+
+static void local_search(heuristic_search *h) {
+    while (!out_of_time(h)) {
+        bool improved = two_opt(h);
+        if (!or_opt(h) && !improved)
+            break;
+    }
+}
+
+static void double_bridge(heuristic_search *h) {
+    int count = h->count;
+    int cut[3];
+
+    do {
+        for (int k = 0; k < 3; k++)
+            cut[k] = 1 + next_random(h) % (count - 1);
+        if (cut[0] > cut[1]) swap(cut[0], cut[1]);
+        if (cut[1] > cut[2]) swap(cut[1], cut[2]);
+        if (cut[0] > cut[1]) swap(cut[0], cut[1]);
+    } while (cut[0] == cut[1] || cut[1] == cut[2]);
+
+    // A B C D becomes A C B D
+    int out = cut[0];
+    memcpy(h->spare, h->order, cut[0] * sizeof(int));
+    memcpy(h->spare + out, h->order + cut[1], (cut[2] - cut[1]) * sizeof(int));
+    out += cut[2] - cut[1];
+    memcpy(h->spare + out, h->order + cut[0], (cut[1] - cut[0]) * sizeof(int));
+    out += cut[1] - cut[0];
+    memcpy(h->spare + out, h->order + cut[2], (count - cut[2]) * sizeof(int));
+    memcpy(h->order, h->spare, count * sizeof(int));
+}
+
+// The bound. An open path is a spanning tree, so it costs at least as much as
+// the minimum spanning tree. A cycle is a path through everyone but node 0 plus
+// two hops at node 0, so at least the tree over the rest plus node 0's two
+// cheapest. Prim's, O(n^2), in the signed costs so it works for highest too.
+static int tour_bound(heuristic_search *h, path_shape shape) {
+    int n = h->n;
+    int skip = (shape == path_CLOSED) ? 0 : -1;
+    int bound = 0;
+
+    if (shape == path_CLOSED && n < 3)
+        return cycle_cost(h, h->order);
+
+    int *nearest = malloc(n * sizeof(int));
+    bool *in_tree = calloc(n, sizeof(bool));
+    if (!nearest || !in_tree) {
+        free(nearest);
+        free(in_tree);
+        return h->sign > 0 ? INT_MIN : INT_MAX;
+    }
+
+    int root = skip + 1;
+    for (int c = 0; c < n; c++)
+        nearest[c] = hop_cost(h, root, c);
+    in_tree[root] = true;
+    if (skip >= 0)
+        in_tree[skip] = true;
+
+    for (int added = root + 1; added < n; added++) {
+        int next = -1;
+        for (int c = 0; c < n; c++) {
+            if (!in_tree[c] && (next < 0 || nearest[c] < nearest[next]))
+                next = c;
+        }
+        bound += nearest[next];
+        in_tree[next] = true;
+        for (int c = 0; c < n; c++) {
+            if (!in_tree[c])
+                nearest[c] = MIN(nearest[c], hop_cost(h, next, c));
+        }
+    }
+
+    if (skip >= 0) {
+        int first = INT_MAX, second = INT_MAX;
+        for (int c = 1; c < n; c++) {
+            int cost = hop_cost(h, skip, c);
+            if (cost < first) {
+                second = first;
+                first = cost;
+            }
+            else if (cost < second)
+                second = cost;
+        }
+        bound += first + second;
+    }
+
+    free(nearest);
+    free(in_tree);
+    return bound;
+}
+
+static bool solve_heuristic(const cost_matrix *m, path_shape shape, bool highest, double budget,
+                            tour *t, long *evaluations) {
+    heuristic_search h;
+    int n = m->count;
+
+    h.m = m;
+    h.n = n;
+    h.count = n + (shape == path_OPEN);
+    h.sign = highest ? -1 : 1;
+    h.deadline = wall_seconds() + budget;
+    h.random = 2463534242u;
+    h.evaluations = 0;
+    h.order = malloc(h.count * sizeof(int));
+    h.spare = malloc(h.count * sizeof(int));
+    int *best = malloc(h.count * sizeof(int));
+
+    if (!h.order || !h.spare || !best || !tour_resize(t, n)) {
+        fprintf(stderr, "error: cannot allocate memory for %d nodes.\n", n);
+        free(h.order);
+        free(h.spare);
+        free(best);
+        return false;
+    }
+
+    nearest_neighbour(&h, 0);
+    local_search(&h);
+    int best_cost = cycle_cost(&h, h.order);
+    memcpy(best, h.order, h.count * sizeof(int));
+
+    while (h.count >= 8 && !out_of_time(&h)) {
+        double_bridge(&h);
+        local_search(&h);
+        int cost = cycle_cost(&h, h.order);
+        if (cost <= best_cost) {
+            best_cost = cost;
+            memcpy(best, h.order, h.count * sizeof(int));
+        }
+        else
+            memcpy(h.order, best, h.count * sizeof(int));
+    }
+
+    // an open path starts right after the dummy
+    int start = 0;
+    if (shape == path_OPEN) {
+        while (best[start] != n)
+            start++;
+        start++;
+    }
+    for (int k = 0; k < n; k++)
+        t->order[k] = best[(start + k) % h.count];
+    t->cost = tour_cost(m, shape, t->order, n);
+    t->bound = h.sign * tour_bound(&h, shape);
+    *evaluations += h.evaluations;
+
+    free(h.order);
+    free(h.spare);
+    free(best);
+    return true;
+}
+
+bool tsp_solve(const cost_matrix *m, tsp_options *opt, tour *lowest, tour *highest) {
+    bool ok = false;
+
+    opt->evaluations = 0;
+
+    if (m->count < 1) {
+        fprintf(stderr, "error: there's nothing to tour.\n");
+        return false;
+    }
+
+    switch (opt->solver) {
+        case solver_BRUTE:
+        case solver_BNB:
+            ok = solve_walk(m, opt, lowest, highest);
+            break;
+
+        case solver_DP:
+            if (m->count - (opt->shape == path_CLOSED) > TSP_MAX_DP_NODES) {
+                fprintf(stderr, "error: %d nodes is too many for dp.\n", m->count);
+                return false;
+            }
+            ok = (!lowest || solve_held_karp(m, opt->shape, false, lowest, &opt->evaluations)) &&
+                 (!highest || solve_held_karp(m, opt->shape, true, highest, &opt->evaluations));
+            break;
+
+        case solver_HEURISTIC: {
+            if (!m->symmetric) {
+                fprintf(stderr, "error: the heuristic needs symmetric costs.\n");
+                return false;
+            }
+            // the budget is for the whole call, so split it if it's both
+            double budget = (lowest && highest) ? opt->time_budget / 2 : opt->time_budget;
+            return (!lowest || solve_heuristic(m, opt->shape, false, budget, lowest, &opt->evaluations)) &&
+                   (!highest || solve_heuristic(m, opt->shape, true, budget, highest, &opt->evaluations));
+        }
+    }
+
+    // the exact solvers' answers are their own bounds
+    if (ok && lowest)
+        lowest->bound = lowest->cost;
+    if (ok && highest)
+        highest->bound = highest->cost;
+    return ok;
+}
@@ -0,0 +1,102 @@
+// AOC 2015 solution in C
+// @chadsy
+// Copyright (C) 2021 Chad Royal
+// MIT License http://opensource.org/licenses/MIT
+//
+// Traveling salesperson helpers, shared by day09 and day13.
+//
+// Day 13 started life as a copy of day09, and every speedup since has had to be
+// done twice. So the common parts live here: a table of names, a cost matrix,
+// and the solvers. A tour is either an open path (day09's delivery route, start
+// and end anywhere) or a closed cycle (day13's round table). The solvers find
+// the lowest cost tour, the highest, or both in the same go, over symmetric or
+// asymmetric costs. There's brute force, branch and bound, and Held-Karp dp,
+// all exact, and they all take the same options so they're easy to compare.
+// For the graphs way past what those can finish, there's a heuristic too,
+// which runs for a time budget and says how far from a bound it might be.
+
+#ifndef TSP_H
+#define TSP_H
+
+#include <stdbool.h>
+
+// Names get an index in the order they're first seen, which is what the cost
+// matrix and the tours use. slots is an open addressed hash of the names, each
+// one index + 1 (0 is empty), so lookups stay quick with thousands of them.
+typedef struct {
+    int count;
+    int capacity;
+    char **names;
+    int slot_count;
+    int *slots;
+} name_table;
+
+void name_table_init(name_table *t);
+void name_table_free(name_table *t);
+int name_lookup(const name_table *t, const char *name);   // -1 if it's not there
+int name_intern(name_table *t, const char *name);         // adds it if it's not there
+
+// cost[from][to], in one block that grows as nodes get added. Anything never
+// set is 0. symmetric just promises cost(a,b) == cost(b,a), which lets the
+// solvers skip tours that are the mirror image of another one.
+typedef struct {
+    int count;
+    int capacity;
+    int *cost;
+    bool symmetric;
+} cost_matrix;
+
+void cost_matrix_init(cost_matrix *m, bool symmetric);
+void cost_matrix_free(cost_matrix *m);
+bool cost_matrix_resize(cost_matrix *m, int count);
+
+#define get_cost(m, from, to)       ((m)->cost[(size_t)(from) * (m)->capacity + (to)])
+#define set_cost(m, from, to, c)    ((m)->cost[(size_t)(from) * (m)->capacity + (to)] = (c))
+
+typedef enum {
+    path_OPEN,
+    path_CLOSED,
+} path_shape;
+
+typedef enum {
+    solver_BRUTE,
+    solver_BNB,
+    solver_DP,
+    solver_HEURISTIC,
+} tsp_solver;
+
+#define TSP_MAX_THREADS     64
+#define TSP_MAX_DP_NODES    22
+
+// bound is the best any tour could possibly do, which for the exact solvers is
+// just cost. The heuristic can only promise its cost is within bound of it.
+typedef struct {
+    int cost;
+    int bound;
+    int count;
+    int *order;
+} tour;
+
+void tour_init(tour *t);
+void tour_free(tour *t);
+bool tour_resize(tour *t, int count);
+int tour_cost(const cost_matrix *m, path_shape shape, const int *order, int count);
+
+typedef struct {
+    tsp_solver solver;
+    path_shape shape;
+    int thread_count;       // for brute and bnb
+    double time_budget;     // seconds, for the heuristic
+    long evaluations;       // filled in: tours, nodes, dp steps or moves, by solver
+} tsp_options;
+
+void tsp_options_init(tsp_options *opt, path_shape shape);
+
+// Solves for the lowest and/or highest cost tour over every node in the matrix,
+// either of which can be NULL if it's not wanted.
+bool tsp_solve(const cost_matrix *m, tsp_options *opt, tour *lowest, tour *highest);
+
+bool parse_solver(const char *name, tsp_solver *solver);
+const char *solver_name(tsp_solver solver);
+
+#endif